@@ -10,10 +10,72 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <cstdio>
 #include <cstring>
+#include <cmath>
 #include <cstdint>
 #include <map>
+#include <set>
 #include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "texpack.h"
+
+#ifdef _WIN32
+    #include <io.h>
+    #define isatty _isatty
+    #define fileno _fileno
+#else
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <signal.h>
+    #include <sys/mman.h>
+    #include <sys/resource.h>
+    #include <sys/uio.h>
+    #include <sys/wait.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    #define X86_KERNELS 1
+    #include <immintrin.h>
+#elif defined(__aarch64__)
+    #include <arm_neon.h>
+#endif
+
+#ifdef __linux__
+    #include <linux/fiemap.h>
+    #include <linux/fs.h>
+    #include <pthread.h>
+    #include <sched.h>
+    #include <sys/ioctl.h>
+    #include <sys/stat.h>
+#endif
+
+// io_uring is driven through raw syscalls, so only the kernel headers are needed.
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #include <linux/io_uring.h>
+        #include <sys/syscall.h>
+        #ifdef __NR_io_uring_setup
+            #define HAVE_IO_URING 1
+        #endif
+    #endif
+#endif
 
 using u8 = uint8_t;
 using u16 = uint16_t;
@@ -21,6 +83,9 @@ using u32 = uint32_t;
 using u64 = uint64_t;
 using i64 = int64_t;
 
+// Per-texture console logging. Batch mode turns this off and shows a progress line instead.
+bool verbose = true;
+
 
 // ============================================================================
 // DATA TABLES 
@@ -60,32 +125,163 @@ std::map<u32, BlockDim> blkDims = {
 // UTILITY FUNCTIONS
 // ============================================================================
 
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr bool HOST_BIG_ENDIAN = true;
+#else
+constexpr bool HOST_BIG_ENDIAN = false;
+#endif
+
+#ifdef _MSC_VER
+inline u16 byteSwap(u16 v) { return _byteswap_ushort(v); }
+inline u32 byteSwap(u32 v) { return _byteswap_ulong(v); }
+inline u64 byteSwap(u64 v) { return _byteswap_uint64(v); }
+#else
+inline u16 byteSwap(u16 v) { return __builtin_bswap16(v); }
+inline u32 byteSwap(u32 v) { return __builtin_bswap32(v); }
+inline u64 byteSwap(u64 v) { return __builtin_bswap64(v); }
+#endif
+
+// Reads fields stored in one byte order. Every read is a single unaligned load,
+// plus a bswap only when the file's order is not the host's, so parsers
+// templated on this pay nothing for the order they were instantiated for.
+template <bool BigEndian>
+struct ByteOrder {
+    static constexpr bool BIG = BigEndian;
+
+    template <typename T>
+    static T load(const u8* data) {
+        T v;
+        std::memcpy(&v, data, sizeof(T));
+        return BigEndian == HOST_BIG_ENDIAN ? v : byteSwap(v);
+    }
+    static u16 read16(const u8* data) { return load<u16>(data); }
+    static u32 read32(const u8* data) { return load<u32>(data); }
+    static u64 read64(const u8* data) { return load<u64>(data); }
+    static i64 read64Signed(const u8* data) { return (i64)load<u64>(data); }
+};
+using LittleEndian = ByteOrder<false>;
+using BigEndian = ByteOrder<true>;
+
 inline u32 Read32LE(const u8* data) {
-    return data[0] | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
+    return LittleEndian::read32(data);
 }
 
 inline u16 Read16LE(const u8* data) {
-    return data[0] | (data[1] << 8);
+    return LittleEndian::read16(data);
 }
 
 inline u64 Read64LE(const u8* data) {
-    u64 result = 0;
-    for (int i = 0; i < 8; i++) {
-        result |= ((u64)data[i]) << (i * 8);
-    }
-    return result;
+    return LittleEndian::read64(data);
 }
 
 inline i64 Read64LE_Signed(const u8* data) {
-    return (i64)Read64LE(data);
+    return LittleEndian::read64Signed(data);
 }
 
-std::string ReadString(const u8* data, size_t maxLen) {
-    std::string result;
-    for (size_t i = 0; i < maxLen && data[i] != 0; i++) {
-        result += (char)data[i];
+// ============================================================================
+// MEMORY ACCOUNTING
+// ============================================================================
+
+// Every large buffer in the extraction path is allocated through a
+// StageAllocator, so current and peak bytes per stage are exact rather than
+// estimated at the call sites.
+enum MemoryStage { MEM_FILE_BUFFER, MEM_TEXTURE_DATA, MEM_UNTILED, MEM_HEADERS, MEM_STAGE_COUNT };
+const char* MEMORY_STAGE_NAMES[MEM_STAGE_COUNT] = {"file_buffer", "texture_data", "untiled", "headers"};
+
+struct MemoryStats {
+    std::atomic<i64> current[MEM_STAGE_COUNT] = {};
+    std::atomic<i64> peak[MEM_STAGE_COUNT] = {};
+    std::atomic<i64> totalCurrent{0};
+    std::atomic<i64> totalPeak{0};
+
+    void allocated(MemoryStage stage, size_t bytes) {
+        raise(peak[stage], current[stage].fetch_add(bytes, std::memory_order_relaxed) + (i64)bytes);
+        raise(totalPeak, totalCurrent.fetch_add(bytes, std::memory_order_relaxed) + (i64)bytes);
     }
-    return result;
+
+    void released(MemoryStage stage, size_t bytes) {
+        current[stage].fetch_sub(bytes, std::memory_order_relaxed);
+        totalCurrent.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    // Folds in peaks measured elsewhere, such as in a forked worker.
+    void mergePeaks(const u64* stagePeaks, u64 total) {
+        for (int st = 0; st < MEM_STAGE_COUNT; st++) raise(peak[st], (i64)stagePeaks[st]);
+        raise(totalPeak, (i64)total);
+    }
+
+private:
+    static void raise(std::atomic<i64>& peakValue, i64 value) {
+        i64 seen = peakValue.load(std::memory_order_relaxed);
+        while (value > seen && !peakValue.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+    }
+};
+
+MemoryStats memoryStats;
+
+template <typename T, MemoryStage S>
+struct StageAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind { using other = StageAllocator<U, S>; };
+
+    StageAllocator() = default;
+    template <typename U>
+    StageAllocator(const StageAllocator<U, S>&) {}
+
+    T* allocate(size_t n) {
+        T* p = std::allocator<T>().allocate(n);
+        memoryStats.allocated(S, n * sizeof(T));
+        return p;
+    }
+
+    void deallocate(T* p, size_t n) {
+        memoryStats.released(S, n * sizeof(T));
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const StageAllocator<U, S>&) const { return true; }
+    template <typename U>
+    bool operator!=(const StageAllocator<U, S>&) const { return false; }
+};
+
+template <MemoryStage S>
+using StageBuffer = std::vector<u8, StageAllocator<u8, S>>;
+
+using FileBuffer = StageBuffer<MEM_FILE_BUFFER>;
+using TextureBuffer = StageBuffer<MEM_TEXTURE_DATA>;
+using SurfaceBuffer = StageBuffer<MEM_UNTILED>;
+using HeaderBuffer = StageBuffer<MEM_HEADERS>;
+
+// Peak resident set size of this process in bytes, 0 where unavailable.
+u64 peakRSS() {
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return (u64)usage.ru_maxrss;
+#else
+    return (u64)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+// Bytes one input file needed in each stage.
+struct FileMemory {
+    u64 fileBuffer = 0;
+    u64 textureData = 0;
+    u64 untiled = 0;
+    u64 headers = 0;
+};
+
+std::string formatMB(u64 bytes) {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(1) << bytes / (1024.0 * 1024.0) << " MB";
+    return ss.str();
 }
 
 // ============================================================================
@@ -117,17 +313,12 @@ u32 getAddrBlockLinear(u32 x, u32 y, u32 image_width, u32 bytes_per_pixel,
     return Address;
 }
 
-std::vector<u8> deswizzle(u32 width, u32 height, u32 blkWidth, u32 blkHeight, 
-                          u32 bpp, u32 tileMode, u32 alignment, u32 size_range, 
-                          const std::vector<u8>& data) {
-    
+// Pitch and total size of a surface as deswizzle() lays it out; width and
+// height are in blocks.
+void surfaceLayout(u32 width, u32 height, u32 bpp, u32 tileMode, u32 alignment, u32 size_range,
+                   u32& pitch, u32& surfSize) {
     u32 block_height = 1 << size_range;
     
-    width = DIV_ROUND_UP(width, blkWidth);
-    height = DIV_ROUND_UP(height, blkHeight);
-    
-    u32 pitch, surfSize;
-    
     if (tileMode == 0) {
         pitch = round_up(width * bpp, 32);
         surfSize = round_up(pitch * height, alignment);
@@ -135,8 +326,21 @@ std::vector<u8> deswizzle(u32 width, u32 height, u32 blkWidth, u32 blkHeight,
         pitch = round_up(width * bpp, 64);
         surfSize = round_up(pitch * round_up(height, block_height * 8), alignment);
     }
+}
+
+SurfaceBuffer deswizzle(u32 width, u32 height, u32 blkWidth, u32 blkHeight, 
+                        u32 bpp, u32 tileMode, u32 alignment, u32 size_range, 
+                        const TextureBuffer& data) {
+    
+    u32 block_height = 1 << size_range;
+    
+    width = DIV_ROUND_UP(width, blkWidth);
+    height = DIV_ROUND_UP(height, blkHeight);
     
-    std::vector<u8> result(surfSize, 0);
+    u32 pitch, surfSize;
+    surfaceLayout(width, height, bpp, tileMode, alignment, size_range, pitch, surfSize);
+    
+    SurfaceBuffer result(surfSize, 0);
     
     for (u32 y = 0; y < height; y++) {
         for (u32 x = 0; x < width; x++) {
@@ -163,8 +367,8 @@ std::vector<u8> deswizzle(u32 width, u32 height, u32 blkWidth, u32 blkHeight,
 // DDS HEADER GENERATION
 // ============================================================================
 
-std::vector<u8> generateDDSHeader(u32 width, u32 height, u32 format, u32 size) {
-    std::vector<u8> header(128, 0);
+HeaderBuffer generateDDSHeader(u32 width, u32 height, u32 format, u32 size) {
+    HeaderBuffer header(128, 0);
     
     // DDS magic
     header[0] = 'D'; header[1] = 'D'; header[2] = 'S'; header[3] = ' ';
@@ -218,6 +422,63 @@ std::vector<u8> generateDDSHeader(u32 width, u32 height, u32 format, u32 size) {
     return header;
 }
 
+// DXGI format for a stored sRGB format, or 0 if DDS has none.
+u32 srgbDXGIFormat(u32 formatType) {
+    switch (formatType) {
+    case 0x0b: return 29;   // R8G8B8A8_UNORM_SRGB
+    case 0x1a: return 72;   // BC1_UNORM_SRGB
+    case 0x1b: return 75;   // BC2_UNORM_SRGB
+    case 0x1c: return 78;   // BC3_UNORM_SRGB
+    case 0x20: return 99;   // BC7_UNORM_SRGB
+    default: return 0;
+    }
+}
+
+// Switches a header to the DX10 extension, the only way DDS marks sRGB data.
+void useDX10Header(HeaderBuffer& header, u32 dxgiFormat) {
+    std::memset(&header[80], 0, 28);
+    u32 pfFlags = 0x4;
+    std::memcpy(&header[80], &pfFlags, 4);
+    std::memcpy(&header[84], "DX10", 4);
+    
+    // dxgiFormat, resourceDimension (TEXTURE2D), miscFlag, arraySize, miscFlags2
+    u32 dx10[5] = {dxgiFormat, 3, 0, 1, 0};
+    header.resize(148);
+    std::memcpy(&header[128], dx10, sizeof(dx10));
+}
+
+// Header for decoded output: uncompressed 32-bit RGBA or 24-bit RGB, R in the
+// low byte.
+HeaderBuffer generateRGB8DDSHeader(u32 width, u32 height, bool alpha) {
+    u32 bytesPerPixel = alpha ? 4 : 3;
+    HeaderBuffer header = generateDDSHeader(width, height, 0, width * bytesPerPixel);
+    
+    // Flags: CAPS | HEIGHT | WIDTH | PIXELFORMAT | PITCH
+    u32 flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x8;
+    std::memcpy(&header[8], &flags, 4);
+    
+    // Pixel format flags (RGB, plus ALPHAPIXELS), bit count and channel masks
+    u32 pf[6] = {alpha ? 0x41u : 0x40u, 0, bytesPerPixel * 8, 0x000000FF, 0x0000FF00, 0x00FF0000};
+    std::memcpy(&header[80], pf, sizeof(pf));
+    u32 alphaMask = alpha ? 0xFF000000 : 0;
+    std::memcpy(&header[104], &alphaMask, 4);
+    
+    return header;
+}
+
+// Marks a header as holding mipCount levels, largest first.
+void setDDSMipCount(HeaderBuffer& header, u32 mipCount) {
+    std::memcpy(&header[28], &mipCount, 4);
+    
+    u32 flags, caps1;
+    std::memcpy(&flags, &header[8], 4);
+    std::memcpy(&caps1, &header[108], 4);
+    flags |= 0x20000;           // MIPMAPCOUNT
+    caps1 |= 0x8 | 0x400000;    // COMPLEX | MIPMAP
+    std::memcpy(&header[8], &flags, 4);
+    std::memcpy(&header[108], &caps1, 4);
+}
+
 // ============================================================================
 // BNTX STRUCTURES
 // ============================================================================
@@ -231,190 +492,5705 @@ struct BNTXTexture {
     u32 sizeRange;
     u32 alignment;
     u32 imageSize;
-    std::vector<u8> data;
+    u32 compSel;
+    u64 dataOffset;
+    TextureBuffer data;
 };
 
+// Block size and bytes per block of a format type (format >> 8); false if unknown.
+bool formatInfo(u32 formatType, u32& blkWidth, u32& blkHeight, u32& bpp) {
+    if (formats.find(formatType) == formats.end()) return false;
+    
+    blkWidth = 1;
+    blkHeight = 1;
+    bpp = 4;
+    
+    auto blkIt = blkDims.find(formatType);
+    if (blkIt != blkDims.end()) {
+        blkWidth = blkIt->second.first;
+        blkHeight = blkIt->second.second;
+    }
+    
+    auto bppIt = bpps.find(formatType);
+    if (bppIt != bpps.end()) {
+        bpp = bppIt->second;
+    }
+    return true;
+}
+
 // ============================================================================
-// BNTX PARSER
+// SIMD KERNELS
 // ============================================================================
 
-std::vector<BNTXTexture> parseBNTX(const std::vector<u8>& f) {
-    std::vector<BNTXTexture> textures;
-    
-    if (f.size() < 0x100) {
-        std::cerr << "File too small!" << std::endl;
-        return textures;
+// Every vectorised inner loop exists once per instruction set and is called
+// through the kernels table, bound at startup to the best set the CPU has or
+// to the one forced with --isa, so one binary runs on every machine of a
+// mixed farm. A kernel does the largest prefix it can and returns how much
+// that was; callers finish the tail with scalar code, which is why the scalar
+// entries only return 0.
+
+#if defined(X86_KERNELS) && defined(__GNUC__)
+    #define TARGET(isa) __attribute__((target(isa)))
+#else
+    #define TARGET(isa)
+#endif
+
+enum Isa { ISA_SCALAR, ISA_SSE2, ISA_SSSE3, ISA_AVX2, ISA_NEON, ISA_COUNT };
+const char* ISA_NAMES[ISA_COUNT] = {"scalar", "sse2", "ssse3", "avx2", "neon"};
+
+bool isaSupported(Isa isa) {
+#if defined(X86_KERNELS) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (isa == ISA_SSE2) return __builtin_cpu_supports("sse2");
+    if (isa == ISA_SSSE3) return __builtin_cpu_supports("ssse3");
+    if (isa == ISA_AVX2) return __builtin_cpu_supports("avx2");
+#elif defined(X86_KERNELS)
+    if (isa == ISA_SSE2) return true;   // x64 baseline; wider sets need the GCC/Clang builtins
+#elif defined(__aarch64__)
+    if (isa == ISA_NEON) return true;
+#endif
+    return isa == ISA_SCALAR;
+}
+
+struct Kernels {
+    // storePixels: pshufb-style byte shuffle, then OR, over RGBA8 pixels.
+    u32 (*shufflePixels)(const u8* shuffle, const u8* ones, const u8* src, u8* dst, u32 count);
+    // reconstructNormalZ, in place.
+    u32 (*normalZ)(u8* px, u32 count);
+    // TextureStats::accumulate: folds pixels into the caller's running min/max
+    // byte lanes and the luma histogram, and returns this call's sums per
+    // channel and alpha == 255 / alpha == 0 counts.
+    u32 (*pixelStats)(const u8* px, u32 count, u8* lo, u8* hi, u32* sums, u32* alpha, u64* histogram);
+    // allBlocksEqual: compares against a 16-byte pattern; false at the first
+    // difference, otherwise done is how many bytes were compared.
+    bool (*blocksEqual)(const u8* data, size_t size, const u8* pattern, size_t& done);
+    // downsampleRows: 2x2 box filter of RGBA8, count output texels.
+    u32 (*boxFilterRGBA)(const u8* row0, const u8* row1, u8* out, u32 count);
+};
+
+u32 shufflePixelsScalar(const u8*, const u8*, const u8*, u8*, u32) { return 0; }
+u32 normalZScalar(u8*, u32) { return 0; }
+u32 pixelStatsScalar(const u8*, u32, u8*, u8*, u32*, u32*, u64*) { return 0; }
+bool blocksEqualScalar(const u8*, size_t, const u8*, size_t& done) { done = 0; return true; }
+u32 boxFilterRGBAScalar(const u8*, const u8*, u8*, u32) { return 0; }
+
+#if defined(X86_KERNELS)
+
+TARGET("sse2") u32 normalZSSE2(u8* px, u32 count) {
+    const __m128i byteMask = _mm_set1_epi32(0xFF);
+    const __m128i keepRG = _mm_set1_epi32(0x0000FFFF);
+    const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
+    const __m128 scale = _mm_set1_ps(1.0f / 127.5f), one = _mm_set1_ps(1.0f), half = _mm_set1_ps(127.5f);
+    u32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(px + i * 4));
+        __m128 x = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(p, byteMask)), scale), one);
+        __m128 y = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 8), byteMask)), scale), one);
+        __m128 zz = _mm_max_ps(_mm_sub_ps(_mm_sub_ps(one, _mm_mul_ps(x, x)), _mm_mul_ps(y, y)), _mm_setzero_ps());
+        __m128i z = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_sqrt_ps(zz), half), half));
+        p = _mm_or_si128(_mm_or_si128(_mm_and_si128(p, keepRG), _mm_slli_epi32(z, 16)), opaque);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(px + i * 4), p);
     }
-   
-    if (std::memcmp(&f[0], "BNTX", 4) != 0) {
-        std::cerr << "Not a valid BNTX file!" << std::endl;
-        return textures;
+    return i;
+}
+
+// Luma of four pixels is (77 R + 150 G + 29 B + 128) >> 12: madd gives the
+// R+G and B parts of each pixel, which are then paired up across registers.
+TARGET("sse2") u32 pixelStatsSSE2(const u8* px, u32 count, u8* laneLo, u8* laneHi, u32* laneSum, u32* alpha,
+                                  u64* histogram) {
+    const __m128i zero = _mm_setzero_si128(), ones = _mm_set1_epi8((char)0xFF);
+    const __m128i weights = _mm_setr_epi16(77, 150, 29, 0, 77, 150, 29, 0), round = _mm_set1_epi32(128);
+    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(laneLo));
+    __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(laneHi));
+    __m128i sums = zero;
+    alignas(16) u32 bins[4];
+    u32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(px + i * 4));
+        lo = _mm_min_epu8(lo, p);
+        hi = _mm_max_epu8(hi, p);
+        __m128i p01 = _mm_unpacklo_epi8(p, zero), p23 = _mm_unpackhi_epi8(p, zero);
+        __m128i wide = _mm_add_epi16(p01, p23);
+        sums = _mm_add_epi32(sums, _mm_add_epi32(_mm_unpacklo_epi16(wide, zero), _mm_unpackhi_epi16(wide, zero)));
+        alpha[0] += (u32)std::bitset<16>(_mm_movemask_epi8(_mm_cmpeq_epi8(p, ones)) & 0x8888).count();
+        alpha[1] += (u32)std::bitset<16>(_mm_movemask_epi8(_mm_cmpeq_epi8(p, zero)) & 0x8888).count();
+        __m128 m01 = _mm_castsi128_ps(_mm_madd_epi16(p01, weights));
+        __m128 m23 = _mm_castsi128_ps(_mm_madd_epi16(p23, weights));
+        __m128i luma = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(m01, m23, _MM_SHUFFLE(2, 0, 2, 0))),
+                                     _mm_castps_si128(_mm_shuffle_ps(m01, m23, _MM_SHUFFLE(3, 1, 3, 1))));
+        _mm_store_si128(reinterpret_cast<__m128i*>(bins), _mm_srli_epi32(_mm_add_epi32(luma, round), 12));
+        for (u32 b : bins) histogram[b]++;
     }
-    
-    bool littleEndian = (f[0xc] == 0xFF && f[0xd] == 0xFE);
-    if (!littleEndian) {
-        std::cerr << "Big endian not supported!" << std::endl;
-        return textures;
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(laneLo), lo);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(laneHi), hi);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(laneSum), sums);
+    return i;
+}
+
+TARGET("sse2") bool blocksEqualSSE2(const u8* data, size_t size, const u8* pattern, size_t& done) {
+    __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m128i eq = _mm_and_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), p),
+                          _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16)), p)),
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 32)), p),
+                          _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 48)), p)));
+        if (_mm_movemask_epi8(eq) != 0xFFFF) return false;
     }
-    
-    std::cout << "BNTX file detected" << std::endl;
-    
-    u32 pos = 0;
-    u32 fileNameAddr = Read32LE(&f[pos + 0x10]);
-    u32 fileSize = Read32LE(&f[pos + 0x1C]);
-    
-    std::string fileName = ReadString(&f[fileNameAddr], 256);
-    std::cout << "File name: " << fileName << std::endl;
-    std::cout << "File size: " << fileSize << std::endl;
-    
-    pos += 0x20; 
-    
-    if (std::memcmp(&f[pos], "NX  ", 4) != 0) {
-        std::cerr << "Invalid NX header!" << std::endl;
-        return textures;
+    done = i;
+    return true;
+}
+
+// Two output texels from four source texels of each row.
+TARGET("sse2") u32 boxFilterRGBASSE2(const u8* r0, const u8* r1, u8* out, u32 count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    u32 x = 0;
+    for (; x + 2 <= count; x += 2) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x * 8));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x * 8));
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+        hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+        __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(_mm_srli_epi16(sum, 2), zero));
     }
-    
-    u32 texCount = Read32LE(&f[pos + 0x04]);
-    i64 infoPtrAddr = Read64LE_Signed(&f[pos + 0x08]);
-    i64 dataBlkAddr = Read64LE_Signed(&f[pos + 0x10]);
-    
-    std::cout << "Textures count: " << texCount << std::endl;
-    
-    for (u32 i = 0; i < texCount; i++) {
-        i64 infoPtr = infoPtrAddr + i * 8;
-        i64 texInfoAddr = Read64LE_Signed(&f[infoPtr]);
-        
-        if (texInfoAddr < 0 || texInfoAddr >= (i64)f.size()) {
-            std::cerr << "Invalid texture info address!" << std::endl;
-            continue;
-        }
-        
-        pos = texInfoAddr;
-        
-        if (std::memcmp(&f[pos], "BRTI", 4) != 0) {
-            std::cerr << "Invalid BRTI magic!" << std::endl;
-            continue;
+    return x;
+}
+
+TARGET("ssse3") u32 shufflePixelsSSSE3(const u8* shuffle, const u8* ones, const u8* src, u8* dst, u32 count) {
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(shuffle));
+    __m128i o = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ones));
+    u32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(px, s), o));
+    }
+    return i;
+}
+
+// AVX2 variants work on eight pixels; the shuffles stay within 128-bit lanes,
+// which is all a per-pixel pattern needs.
+TARGET("avx2") u32 shufflePixelsAVX2(const u8* shuffle, const u8* ones, const u8* src, u8* dst, u32 count) {
+    __m256i s = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(shuffle)));
+    __m256i o = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ones)));
+    u32 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(px, s), o));
+    }
+    return i;
+}
+
+TARGET("avx2") u32 normalZAVX2(u8* px, u32 count) {
+    const __m256i byteMask = _mm256_set1_epi32(0xFF);
+    const __m256i keepRG = _mm256_set1_epi32(0x0000FFFF);
+    const __m256i opaque = _mm256_set1_epi32((int)0xFF000000);
+    const __m256 scale = _mm256_set1_ps(1.0f / 127.5f), one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(127.5f);
+    u32 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(px + i * 4));
+        __m256 x = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(p, byteMask)), scale), one);
+        __m256 y = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(p, 8), byteMask)), scale), one);
+        __m256 zz = _mm256_max_ps(_mm256_sub_ps(_mm256_sub_ps(one, _mm256_mul_ps(x, x)), _mm256_mul_ps(y, y)), _mm256_setzero_ps());
+        __m256i z = _mm256_cvtps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_sqrt_ps(zz), half), half));
+        p = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(p, keepRG), _mm256_slli_epi32(z, 16)), opaque);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(px + i * 4), p);
+    }
+    return i;
+}
+
+// Eight pixels at a time, luma as in pixelStatsSSE2; the remainder below
+// eight pixels goes through the SSE2 kernel so short block rows stay vectorised.
+TARGET("avx2") u32 pixelStatsAVX2(const u8* px, u32 count, u8* laneLo, u8* laneHi, u32* laneSum, u32* alpha,
+                                  u64* histogram) {
+    const __m256i zero = _mm256_setzero_si256(), ones = _mm256_set1_epi8((char)0xFF);
+    const __m256i weights = _mm256_setr_epi16(77, 150, 29, 0, 77, 150, 29, 0, 77, 150, 29, 0, 77, 150, 29, 0);
+    const __m256i round = _mm256_set1_epi32(128);
+    __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(laneLo)));
+    __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(laneHi)));
+    __m256i sums = zero;
+    alignas(32) u32 bins[8];
+    u32 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(px + i * 4));
+        lo = _mm256_min_epu8(lo, p);
+        hi = _mm256_max_epu8(hi, p);
+        __m256i pLo = _mm256_unpacklo_epi8(p, zero), pHi = _mm256_unpackhi_epi8(p, zero);
+        __m256i wide = _mm256_add_epi16(pLo, pHi);
+        sums = _mm256_add_epi32(sums, _mm256_add_epi32(_mm256_unpacklo_epi16(wide, zero), _mm256_unpackhi_epi16(wide, zero)));
+        alpha[0] += (u32)std::bitset<32>((u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(p, ones)) & 0x88888888).count();
+        alpha[1] += (u32)std::bitset<32>((u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(p, zero)) & 0x88888888).count();
+        __m256 mLo = _mm256_castsi256_ps(_mm256_madd_epi16(pLo, weights));
+        __m256 mHi = _mm256_castsi256_ps(_mm256_madd_epi16(pHi, weights));
+        __m256i luma = _mm256_add_epi32(_mm256_castps_si256(_mm256_shuffle_ps(mLo, mHi, _MM_SHUFFLE(2, 0, 2, 0))),
+                                        _mm256_castps_si256(_mm256_shuffle_ps(mLo, mHi, _MM_SHUFFLE(3, 1, 3, 1))));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(bins), _mm256_srli_epi32(_mm256_add_epi32(luma, round), 12));
+        for (u32 b : bins) histogram[b]++;
+    }
+    __m128i lo128 = _mm_min_epu8(_mm256_castsi256_si128(lo), _mm256_extracti128_si256(lo, 1));
+    __m128i hi128 = _mm_max_epu8(_mm256_castsi256_si128(hi), _mm256_extracti128_si256(hi, 1));
+    __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(laneLo), lo128);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(laneHi), hi128);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(laneSum), sum128);
+    if (i + 4 > count) return i;
+    u32 tailSum[4];
+    u32 done = pixelStatsSSE2(px + i * 4, count - i, laneLo, laneHi, tailSum, alpha, histogram);
+    for (int c = 0; c < 4; c++) laneSum[c] += tailSum[c];
+    return i + done;
+}
+
+TARGET("avx2") bool blocksEqualAVX2(const u8* data, size_t size, const u8* pattern, size_t& done) {
+    __m256i p = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern)));
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m256i eq = _mm256_and_si256(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), p),
+            _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32)), p));
+        if (_mm256_movemask_epi8(eq) != -1) return false;
+    }
+    done = i;
+    return true;
+}
+
+// Four output texels from eight source texels; the per-lane result halves are
+// gathered with one permute.
+TARGET("avx2") u32 boxFilterRGBAAVX2(const u8* r0, const u8* r1, u8* out, u32 count) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i two = _mm256_set1_epi16(2);
+    u32 x = 0;
+    for (; x + 4 <= count; x += 4) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r0 + x * 8));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r1 + x * 8));
+        __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+        __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+        lo = _mm256_add_epi16(lo, _mm256_srli_si256(lo, 8));
+        hi = _mm256_add_epi16(hi, _mm256_srli_si256(hi, 8));
+        __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), two);
+        __m256i packed = _mm256_packus_epi16(_mm256_srli_epi16(sum, 2), zero);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4),
+                         _mm256_castsi256_si128(_mm256_permute4x64_epi64(packed, 0x08)));
+    }
+    return x;
+}
+
+#elif defined(__aarch64__)
+
+u32 shufflePixelsNEON(const u8* shuffle, const u8* ones, const u8* src, u8* dst, u32 count) {
+    uint8x16_t s = vld1q_u8(shuffle);
+    uint8x16_t o = vld1q_u8(ones);
+    u32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        vst1q_u8(dst + i * 4, vorrq_u8(vqtbl1q_u8(vld1q_u8(src + i * 4), s), o));
+    }
+    return i;
+}
+
+u32 normalZNEON(u8* px, u32 count) {
+    const uint32x4_t byteMask = vdupq_n_u32(0xFF);
+    const uint32x4_t keepRG = vdupq_n_u32(0x0000FFFF);
+    const uint32x4_t opaque = vdupq_n_u32(0xFF000000);
+    const float32x4_t scale = vdupq_n_f32(1.0f / 127.5f), one = vdupq_n_f32(1.0f), half = vdupq_n_f32(127.5f);
+    u32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t p = vreinterpretq_u32_u8(vld1q_u8(px + i * 4));
+        float32x4_t x = vsubq_f32(vmulq_f32(vcvtq_f32_u32(vandq_u32(p, byteMask)), scale), one);
+        float32x4_t y = vsubq_f32(vmulq_f32(vcvtq_f32_u32(vandq_u32(vshrq_n_u32(p, 8), byteMask)), scale), one);
+        float32x4_t zz = vmaxq_f32(vsubq_f32(vsubq_f32(one, vmulq_f32(x, x)), vmulq_f32(y, y)), vdupq_n_f32(0));
+        uint32x4_t z = vcvtnq_u32_f32(vaddq_f32(vmulq_f32(vsqrtq_f32(zz), half), half));
+        p = vorrq_u32(vorrq_u32(vandq_u32(p, keepRG), vshlq_n_u32(z, 16)), opaque);
+        vst1q_u8(px + i * 4, vreinterpretq_u8_u32(p));
+    }
+    return i;
+}
+
+u32 pixelStatsNEON(const u8* px, u32 count, u8* laneLo, u8* laneHi, u32* laneSum, u32* alpha, u64* histogram) {
+    const uint8x16_t alphaLanes = vreinterpretq_u8_u32(vdupq_n_u32(0x01000000));
+    const uint32x4_t byteMask = vdupq_n_u32(0xFF);
+    uint8x16_t lo = vld1q_u8(laneLo), hi = vld1q_u8(laneHi);
+    uint32x4_t sums = vdupq_n_u32(0);
+    u32 bins[4];
+    u32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint8x16_t p = vld1q_u8(px + i * 4);
+        lo = vminq_u8(lo, p);
+        hi = vmaxq_u8(hi, p);
+        uint16x8_t wide = vaddq_u16(vmovl_u8(vget_low_u8(p)), vmovl_u8(vget_high_u8(p)));
+        sums = vaddq_u32(sums, vaddl_u16(vget_low_u16(wide), vget_high_u16(wide)));
+        alpha[0] += vaddvq_u8(vandq_u8(vceqq_u8(p, vdupq_n_u8(0xFF)), alphaLanes));
+        alpha[1] += vaddvq_u8(vandq_u8(vceqq_u8(p, vdupq_n_u8(0)), alphaLanes));
+        uint32x4_t p32 = vreinterpretq_u32_u8(p);
+        uint32x4_t luma = vmulq_n_u32(vandq_u32(p32, byteMask), 77);
+        luma = vmlaq_n_u32(luma, vandq_u32(vshrq_n_u32(p32, 8), byteMask), 150);
+        luma = vmlaq_n_u32(luma, vandq_u32(vshrq_n_u32(p32, 16), byteMask), 29);
+        vst1q_u32(bins, vshrq_n_u32(vaddq_u32(luma, vdupq_n_u32(128)), 12));
+        for (u32 b : bins) histogram[b]++;
+    }
+    vst1q_u8(laneLo, lo);
+    vst1q_u8(laneHi, hi);
+    vst1q_u32(laneSum, sums);
+    return i;
+}
+
+bool blocksEqualNEON(const u8* data, size_t size, const u8* pattern, size_t& done) {
+    uint8x16_t p = vld1q_u8(pattern);
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        uint8x16_t eq = vandq_u8(vandq_u8(vceqq_u8(vld1q_u8(data + i), p), vceqq_u8(vld1q_u8(data + i + 16), p)),
+                                 vandq_u8(vceqq_u8(vld1q_u8(data + i + 32), p), vceqq_u8(vld1q_u8(data + i + 48), p)));
+        if (vminvq_u8(eq) != 0xFF) return false;
+    }
+    done = i;
+    return true;
+}
+
+u32 boxFilterRGBANEON(const u8* r0, const u8* r1, u8* out, u32 count) {
+    u32 x = 0;
+    for (; x + 2 <= count; x += 2) {
+        uint8x16_t a = vld1q_u8(r0 + x * 8);
+        uint8x16_t b = vld1q_u8(r1 + x * 8);
+        uint16x8_t lo = vaddl_u8(vget_low_u8(a), vget_low_u8(b));
+        uint16x8_t hi = vaddl_u8(vget_high_u8(a), vget_high_u8(b));
+        uint16x8_t sum = vcombine_u16(vadd_u16(vget_low_u16(lo), vget_high_u16(lo)),
+                                      vadd_u16(vget_low_u16(hi), vget_high_u16(hi)));
+        vst1_u8(out + x * 4, vrshrn_n_u16(sum, 2));
+    }
+    return x;
+}
+
+#endif
+
+Kernels kernelsFor(Isa isa) {
+    Kernels k = {shufflePixelsScalar, normalZScalar, pixelStatsScalar, blocksEqualScalar, boxFilterRGBAScalar};
+#if defined(X86_KERNELS)
+    if (isa >= ISA_SSE2 && isa <= ISA_AVX2) k = {shufflePixelsScalar, normalZSSE2, pixelStatsSSE2, blocksEqualSSE2, boxFilterRGBASSE2};
+    if (isa >= ISA_SSSE3 && isa <= ISA_AVX2) k.shufflePixels = shufflePixelsSSSE3;
+    if (isa == ISA_AVX2) k = {shufflePixelsAVX2, normalZAVX2, pixelStatsAVX2, blocksEqualAVX2, boxFilterRGBAAVX2};
+#elif defined(__aarch64__)
+    if (isa == ISA_NEON) k = {shufflePixelsNEON, normalZNEON, pixelStatsNEON, blocksEqualNEON, boxFilterRGBANEON};
+#endif
+    return k;
+}
+
+Isa bestIsa() {
+    for (int isa = ISA_COUNT - 1; isa > ISA_SCALAR; isa--) {
+        if (isaSupported((Isa)isa)) return (Isa)isa;
+    }
+    return ISA_SCALAR;
+}
+
+Isa activeIsa = bestIsa();
+Kernels kernels = kernelsFor(activeIsa);
+
+// Rebinds every kernel; false if the CPU lacks the set. Call before starting
+// any worker.
+bool useIsa(Isa isa) {
+    if (!isaSupported(isa)) return false;
+    activeIsa = isa;
+    kernels = kernelsFor(isa);
+    return true;
+}
+
+// For --isa: "auto" or one of ISA_NAMES.
+bool selectIsa(const std::string& name) {
+    if (name == "auto") return useIsa(bestIsa());
+    for (int isa = 0; isa < ISA_COUNT; isa++) {
+        if (name == ISA_NAMES[isa]) {
+            if (useIsa((Isa)isa)) return true;
+            std::cerr << "Error: this CPU does not support " << name << std::endl;
+            return false;
         }
-        
-        u8 tileMode = f[pos + 0x10];
-        u16 flags = Read16LE(&f[pos + 0x12]);
-        u16 swizzle = Read16LE(&f[pos + 0x14]);
-        u16 numMips = Read16LE(&f[pos + 0x16]);
-        u32 format = Read32LE(&f[pos + 0x1C]);
-        u32 width = Read32LE(&f[pos + 0x24]);
-        u32 height = Read32LE(&f[pos + 0x28]);
-        u32 sizeRange = Read32LE(&f[pos + 0x34]);
-        u32 imageSize = Read32LE(&f[pos + 0x50]);
-        u32 alignment = Read32LE(&f[pos + 0x54]);
-        i64 nameAddr = Read64LE_Signed(&f[pos + 0x60]);
-        i64 ptrsAddr = Read64LE_Signed(&f[pos + 0x70]);
-        
-        u16 nameLen = Read16LE(&f[nameAddr]);
-        std::string name = ReadString(&f[nameAddr + 2], nameLen);
-        
-        std::cout << "\n=== Image " << (i+1) << " ===" << std::endl;
-        std::cout << "Name: " << name << std::endl;
-        std::cout << "Width: " << width << std::endl;
-        std::cout << "Height: " << height << std::endl;
-        
-        if (formats.find(format) != formats.end()) {
-            std::cout << "Format: " << formats[format] << std::endl;
-        } else {
-            std::cout << "Format: 0x" << std::hex << format << std::dec << std::endl;
+    }
+    std::cerr << "Error: --isa expects auto, scalar, sse2, ssse3, avx2 or neon" << std::endl;
+    return false;
+}
+
+// ============================================================================
+// TEXTURE STATISTICS
+// ============================================================================
+
+// Per-texture statistics gathered by the decoder from each span of output
+// pixels while it is still in cache, so QA needs no second read of the image.
+struct TextureStats {
+    u64 pixels = 0;
+    u8 min[4] = {255, 255, 255, 255};
+    u8 max[4] = {0, 0, 0, 0};
+    u64 sum[4] = {};
+    u64 opaque = 0;             // alpha == 255
+    u64 transparent = 0;        // alpha == 0
+    u64 histogram[16] = {};     // luma in 16 bins
+
+    TextureStats() {
+        std::memset(lanesLo, 0xFF, sizeof(lanesLo));
+    }
+
+    // Folds count RGBA8 pixels in. Min and max run in byte lanes that stay
+    // live for the whole texture and are only folded into min/max by finish();
+    // sums, alpha counts and the histogram come from the same kernel pass.
+    void accumulate(const u8* px, u32 count) {
+        u32 lanesSum[4] = {}, alpha[2] = {};
+        u32 i = kernels.pixelStats(px, count, lanesLo, lanesHi, lanesSum, alpha, histogram);
+        for (int c = 0; c < 4; c++) sum[c] += lanesSum[c];
+        opaque += alpha[0];
+        transparent += alpha[1];
+        for (; i < count; i++) {
+            const u8* p = px + i * 4;
+            for (int c = 0; c < 4; c++) {
+                min[c] = std::min(min[c], p[c]);
+                max[c] = std::max(max[c], p[c]);
+                sum[c] += p[c];
+            }
+            opaque += p[3] == 255;
+            transparent += p[3] == 0;
+            histogram[(77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 12]++;
         }
-        
-        std::cout << "TileMode: " << (tileMode == 0 ? "LINEAR" : "BLOCK_LINEAR") << std::endl;
-        std::cout << "Block Height: " << (1 << sizeRange) << std::endl;
-        std::cout << "Image Size: " << imageSize << std::endl;
-        
-        i64 dataAddr = Read64LE_Signed(&f[ptrsAddr]);
-        
-        if (dataAddr < 0 || dataAddr + imageSize > f.size()) {
-            std::cerr << "Invalid data address!" << std::endl;
-            continue;
+        pixels += count;
+    }
+
+    // Merges the byte lanes into min and max; call once the texture is done.
+    void finish() {
+        for (int lane = 0; lane < 16; lane++) {
+            min[lane % 4] = std::min(min[lane % 4], lanesLo[lane]);
+            max[lane % 4] = std::max(max[lane % 4], lanesHi[lane]);
         }
-        
-        BNTXTexture tex;
-        tex.name = name;
-        tex.width = width;
-        tex.height = height;
-        tex.format = format;
-        tex.tileMode = tileMode;
-        tex.sizeRange = sizeRange;
-        tex.alignment = alignment;
-        tex.imageSize = imageSize;
-        tex.data.resize(imageSize);
-        std::memcpy(tex.data.data(), &f[dataAddr], imageSize);
-        
-        textures.push_back(tex);
     }
-    
-    return textures;
-}
+
+    // "opaque", "binary" (only 0 or 255) or "translucent".
+    const char* alphaUsage() const {
+        if (opaque == pixels) return "opaque";
+        if (opaque + transparent == pixels) return "binary";
+        return "translucent";
+    }
+
+private:
+    u8 lanesLo[16];
+    u8 lanesHi[16] = {};
+};
 
 // ============================================================================
-// TEXTURE EXPORT
+// PIXEL DECODE
 // ============================================================================
 
-void saveTextures(const std::vector<BNTXTexture>& textures, const std::string& outputDir) {
-    for (const auto& tex : textures) {
-        u32 formatType = tex.format >> 8;
-        
-        if (formats.find(formatType) == formats.end()) {
-            std::cout << "\nSkipping " << tex.name << " - unsupported format (0x" 
-                      << std::hex << tex.format << std::dec << ")" << std::endl;
-            continue;
+// BRTI component selector values, one byte per output channel (R, G, B, A).
+enum ChannelSelect { SEL_ZERO = 0, SEL_ONE = 1, SEL_RED = 2, SEL_GREEN = 3, SEL_BLUE = 4, SEL_ALPHA = 5 };
+const u32 COMP_SEL_IDENTITY = 0x05040302;
+
+// BC5 normal-map output: Z is rebuilt from X and Y, written as RGB8 or RGBA8.
+enum NormalMode { NORMAL_OFF, NORMAL_RGB, NORMAL_RGBA };
+
+// Color space of decoded color textures: as stored, or converted to sRGB or
+// linear. Data formats (R8, R8G8, BC4, BC5) and alpha are never converted.
+enum ColorSpace { COLOR_KEEP, COLOR_SRGB, COLOR_LINEAR };
+
+// Decode settings, set once from the command line like verbose.
+struct DecodeOptions {
+    bool enabled = false;
+    NormalMode normalMap = NORMAL_OFF;
+    ColorSpace colorSpace = COLOR_KEEP;
+    u32 scale = 1;      // decode at 1/scale resolution (1, 2, 4, 8 or 16)
+};
+DecodeOptions decodeOptions;
+
+// "RGBA", "RRR1" and so on, for logging.
+std::string compSelName(u32 compSel) {
+    const char names[] = "01RGBA";
+    std::string s;
+    for (int c = 0; c < 4; c++) {
+        u8 sel = (compSel >> (c * 8)) & 0xFF;
+        s += sel <= SEL_ALPHA ? names[sel] : '?';
+    }
+    return s;
+}
+
+// A component selector compiled to a byte shuffle over four RGBA8 pixels:
+// shuffle[i] is the source byte of output byte i, or 0x80 for a constant, and
+// ones holds the 0xFF bytes of SEL_ONE channels. Applying it is one pshufb
+// (tbl on ARM) and one or per four pixels.
+struct ChannelMap {
+    alignas(16) u8 shuffle[16];
+    alignas(16) u8 ones[16];
+    bool identity;
+};
+
+ChannelMap makeChannelMap(u32 compSel) {
+    ChannelMap map;
+    map.identity = compSel == COMP_SEL_IDENTITY;
+    for (int c = 0; c < 4; c++) {
+        u8 sel = (compSel >> (c * 8)) & 0xFF;
+        u8 src = sel >= SEL_RED && sel <= SEL_ALPHA ? sel - SEL_RED : 0x80;
+        for (int px = 0; px < 4; px++) {
+            map.shuffle[px * 4 + c] = src == 0x80 ? 0x80 : px * 4 + src;
+            map.ones[px * 4 + c] = sel == SEL_ONE ? 0xFF : 0;
         }
-        
-        u32 blkWidth = 1, blkHeight = 1, bpp = 4;
-        
-        if (blkDims.find(formatType) != blkDims.end()) {
-            blkWidth = blkDims[formatType].first;
-            blkHeight = blkDims[formatType].second;
+    }
+    return map;
+}
+
+// 8-bit sRGB <-> linear tables, built once.
+const u8* srgbToLinearTable() {
+    static const std::vector<u8> table = [] {
+        std::vector<u8> t(256);
+        for (int i = 0; i < 256; i++) {
+            double c = i / 255.0;
+            double l = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+            t[i] = (u8)std::lround(l * 255.0);
         }
-        
-        if (bpps.find(formatType) != bpps.end()) {
-            bpp = bpps[formatType];
+        return t;
+    }();
+    return table.data();
+}
+
+const u8* linearToSrgbTable() {
+    static const std::vector<u8> table = [] {
+        std::vector<u8> t(256);
+        for (int i = 0; i < 256; i++) {
+            double l = i / 255.0;
+            double c = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+            t[i] = (u8)std::lround(c * 255.0);
         }
-        
-        u32 size = DIV_ROUND_UP(tex.width, blkWidth) * DIV_ROUND_UP(tex.height, blkHeight) * bpp;
-        
-        std::cout << "\nProcessing: " << tex.name << " (" << formats[formatType] << ")" << std::endl;
-        
-        std::vector<u8> result = deswizzle(
-            tex.width, tex.height, 
-            blkWidth, blkHeight, 
-            bpp, tex.tileMode, 
-            tex.alignment, tex.sizeRange, 
-            tex.data
-        );
-        
-        if (result.size() > size) {
-            result.resize(size);
+        return t;
+    }();
+    return table.data();
+}
+
+// Stores count RGBA8 pixels with the channel map applied. Decoders call this
+// on spans that are still in cache, so selectors cost no extra pass. A color
+// table, if given, is applied to R, G and B in the same loop; at 8 bits a
+// 256-byte table lookup beats any vector polynomial, so that path is scalar.
+inline void storePixels(const ChannelMap& map, const u8* src, u8* dst, u32 count, const u8* colorTable = nullptr) {
+    if (colorTable) {
+        for (u32 i = 0; i < count; i++) {
+            for (int c = 0; c < 4; c++) {
+                u8 s = map.shuffle[c];
+                u8 v = (s & 0x80 ? 0 : src[i * 4 + s]) | map.ones[c];
+                dst[i * 4 + c] = c < 3 ? colorTable[v] : v;
+            }
         }
-        
-        std::vector<u8> header = generateDDSHeader(tex.width, tex.height, formatType, size);
-        
-        std::string outName = outputDir + "/" + tex.name + ".dds";
-        std::ofstream out(outName, std::ios::binary);
-        if (!out) {
-            std::cerr << "Failed to create " << outName << std::endl;
-            continue;
+        return;
+    }
+    if (map.identity) {
+        std::memcpy(dst, src, count * 4);
+        return;
+    }
+    u32 i = kernels.shufflePixels(map.shuffle, map.ones, src, dst, count);
+    for (; i < count; i++) {
+        for (int c = 0; c < 4; c++) {
+            u8 s = map.shuffle[c];
+            dst[i * 4 + c] = (s & 0x80 ? 0 : src[i * 4 + s]) | map.ones[c];
         }
-        
-        out.write((char*)header.data(), header.size());
-        out.write((char*)result.data(), result.size());
-        out.close();
-        
-        std::cout << "Saved: " << outName << std::endl;
     }
 }
 
-// ============================================================================
+// Stores count pixels as RGB8, dropping alpha.
+inline void storePixelsRGB(const u8* src, u8* dst, u32 count) {
+    for (u32 i = 0; i < count; i++) std::memcpy(dst + i * 3, src + i * 4, 3);
+}
+
+// Rebuilds tangent-space normals in place: X and Y come from R and G mapped
+// to [-1, 1], B becomes Z = sqrt(1 - X^2 - Y^2) and A is set opaque.
+inline void reconstructNormalZ(u8* px, u32 count) {
+    u32 i = kernels.normalZ(px, count);
+    for (; i < count; i++) {
+        float x = px[i * 4] / 127.5f - 1.0f, y = px[i * 4 + 1] / 127.5f - 1.0f;
+        float z = std::sqrt(std::max(0.0f, 1.0f - x * x - y * y));
+        px[i * 4 + 2] = (u8)std::lrint(z * 127.5f + 127.5f);
+        px[i * 4 + 3] = 255;
+    }
+}
+
+inline void expand565(u16 v, u8* rgb) {
+    u8 r = v >> 11, g = (v >> 5) & 0x3F, b = v & 0x1F;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 color block to 16 RGBA8 pixels. BC2 and BC3 always use four colors.
+void bc1Palette(const u8* block, bool fourColorOnly, u8 palette[4][4]) {
+    u16 c0 = Read16LE(block), c1 = Read16LE(block + 2);
+    expand565(c0, palette[0]);
+    expand565(c1, palette[1]);
+    palette[0][3] = palette[1][3] = 255;
+    for (int c = 0; c < 3; c++) {
+        if (c0 > c1 || fourColorOnly) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = (c0 > c1 || fourColorOnly) ? 255 : 0;
+}
+
+void decodeBC1Block(const u8* block, u8* out, bool fourColorOnly) {
+    u8 palette[4][4];
+    bc1Palette(block, fourColorOnly, palette);
+    u32 indices = Read32LE(block + 4);
+    for (int i = 0; i < 16; i++) {
+        std::memcpy(out + i * 4, palette[(indices >> (i * 2)) & 3], 4);
+    }
+}
+
+// BC4 palette (also BC3 alpha and each BC5 half), signed values already
+// mapped to 0-255.
+void bc4Palette(const u8* block, bool isSigned, u8 out[8]) {
+    int palette[8];
+    int a0 = isSigned ? std::max<int>((int8_t)block[0], -127) : block[0];
+    int a1 = isSigned ? std::max<int>((int8_t)block[1], -127) : block[1];
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1) {
+        for (int i = 1; i < 7; i++) palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    } else {
+        for (int i = 1; i < 5; i++) palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        palette[6] = isSigned ? -127 : 0;
+        palette[7] = isSigned ? 127 : 255;
+    }
+    for (int i = 0; i < 8; i++) {
+        out[i] = isSigned ? (u8)(((palette[i] + 127) * 255 + 127) / 254) : (u8)palette[i];
+    }
+}
+
+inline u64 bc4Indices(const u8* block) {
+    u64 indices = 0;
+    for (int i = 0; i < 6; i++) indices |= (u64)block[2 + i] << (i * 8);
+    return indices;
+}
+
+// BC4 block into one channel of 16 pixels.
+void decodeBC4Block(const u8* block, u8* out, int channel, bool isSigned) {
+    u8 palette[8];
+    bc4Palette(block, isSigned, palette);
+    u64 indices = bc4Indices(block);
+    for (int i = 0; i < 16; i++) {
+        out[i * 4 + channel] = palette[(indices >> (i * 3)) & 7];
+    }
+}
+
+// Decodes one 4x4 block of a BC1-BC5 format to 16 RGBA8 pixels.
+void decodeBCBlock(u32 formatType, bool isSigned, const u8* block, u8* out) {
+    switch (formatType) {
+    case 0x1a:
+        decodeBC1Block(block, out, false);
+        break;
+    case 0x1b:
+        decodeBC1Block(block + 8, out, true);
+        for (int i = 0; i < 16; i++) {
+            u8 a = (block[i / 2] >> ((i % 2) * 4)) & 0xF;
+            out[i * 4 + 3] = a * 17;
+        }
+        break;
+    case 0x1c:
+        decodeBC1Block(block + 8, out, true);
+        decodeBC4Block(block, out, 3, false);
+        break;
+    case 0x1d:
+        for (int i = 0; i < 16; i++) std::memcpy(out + i * 4, "\0\0\0\xFF", 4);
+        decodeBC4Block(block, out, 0, isSigned);
+        break;
+    case 0x1e:
+        for (int i = 0; i < 16; i++) std::memcpy(out + i * 4, "\0\0\0\xFF", 4);
+        decodeBC4Block(block, out, 0, isSigned);
+        decodeBC4Block(block + 8, out, 1, isSigned);
+        break;
+    }
+}
+
+// Formats holding color, as opposed to data such as masks or normals.
+bool isColorFormat(u32 formatType) {
+    return formatType == 0x0b || formatType == 0x07 || formatType == 0x1a || formatType == 0x1b ||
+           formatType == 0x1c || formatType == 0x1f || formatType == 0x20;
+}
+
+inline bool isSRGB(u32 format) {
+    return (format & 0xFF) == 6;
+}
+
+// Table converting a color texture to the requested space, or nullptr if its
+// values stay as stored.
+const u8* colorTableFor(u32 format, ColorSpace space) {
+    if (!isColorFormat(format >> 8)) return nullptr;
+    if (space == COLOR_LINEAR && isSRGB(format)) return srgbToLinearTable();
+    if (space == COLOR_SRGB && !isSRGB(format)) return linearToSrgbTable();
+    return nullptr;
+}
+
+// Per-texture decode settings beyond the format and selectors.
+struct SurfaceDecode {
+    NormalMode normal = NORMAL_OFF;
+    const u8* colorTable = nullptr;
+    u32 scale = 1;
+    TextureStats* stats = nullptr;  // filled from the output pixels if set
+};
+
+// Average color of a BC1-BC5 block from its palettes and an index histogram,
+// without expanding the 16 texels.
+void averageBCBlock(u32 formatType, bool isSigned, const u8* block, u8* out) {
+    auto colorAverage = [&](const u8* colorBlock, bool fourColorOnly) {
+        u8 palette[4][4];
+        bc1Palette(colorBlock, fourColorOnly, palette);
+        u32 count[4] = {};
+        u32 indices = Read32LE(colorBlock + 4);
+        for (int i = 0; i < 16; i++) count[(indices >> (i * 2)) & 3]++;
+        for (int c = 0; c < 4; c++) {
+            u32 sum = 0;
+            for (int k = 0; k < 4; k++) sum += count[k] * palette[k][c];
+            out[c] = (u8)((sum + 8) / 16);
+        }
+    };
+    auto channelAverage = [&](const u8* channelBlock, int channel, bool channelSigned) {
+        u8 palette[8];
+        bc4Palette(channelBlock, channelSigned, palette);
+        u32 count[8] = {};
+        u64 indices = bc4Indices(channelBlock);
+        for (int i = 0; i < 16; i++) count[(indices >> (i * 3)) & 7]++;
+        u32 sum = 0;
+        for (int k = 0; k < 8; k++) sum += count[k] * palette[k];
+        out[channel] = (u8)((sum + 8) / 16);
+    };
+
+    switch (formatType) {
+    case 0x1a:
+        colorAverage(block, false);
+        break;
+    case 0x1b: {
+        colorAverage(block + 8, true);
+        u32 sum = 0;
+        for (int i = 0; i < 8; i++) sum += (block[i] & 0xF) + (block[i] >> 4);
+        out[3] = (u8)((sum * 17 + 8) / 16);
+        break;
+    }
+    case 0x1c:
+        colorAverage(block + 8, true);
+        channelAverage(block, 3, false);
+        break;
+    case 0x1d:
+        std::memcpy(out, "\0\0\0\xFF", 4);
+        channelAverage(block, 0, isSigned);
+        break;
+    case 0x1e:
+        std::memcpy(out, "\0\0\0\xFF", 4);
+        channelAverage(block, 0, isSigned);
+        channelAverage(block + 8, 1, isSigned);
+        break;
+    }
+}
+
+// Expands one texel of an uncompressed format to RGBA8.
+inline void expandTexel(u32 formatType, const u8* in, u8* px) {
+    switch (formatType) {
+    case 0x0b:
+        std::memcpy(px, in, 4);
+        return;
+    case 0x07:
+        expand565(Read16LE(in), px);
+        break;
+    case 0x09:
+        px[0] = in[0];
+        px[1] = in[1];
+        px[2] = 0;
+        break;
+    default:
+        px[0] = in[0];
+        px[1] = px[2] = 0;
+        break;
+    }
+    px[3] = 255;
+}
+
+// True for the formats decodeSurface() handles.
+bool canDecode(u32 formatType) {
+    return formatType == 0x0b || formatType == 0x07 || formatType == 0x02 || formatType == 0x09 ||
+           (formatType >= 0x1a && formatType <= 0x1e);
+}
+
+// Decimated decode at 1/scale resolution, straight from the untiled block
+// stream. Uncompressed formats point-sample the middle of each cell. For BCn
+// at scale 2 each block is decoded and box-filtered to 2x2; from scale 4 up no
+// texel is expanded: each output pixel averages the palette-and-histogram
+// means of the (scale / 4)^2 blocks it covers.
+bool decodeScaled(u32 formatType, bool isSigned, const ChannelMap& map, u32 width, u32 height,
+                  const SurfaceBuffer& src, SurfaceBuffer& dst, u32 scale, NormalMode normal,
+                  const u8* colorTable, TextureStats* stats) {
+    u32 blkWidth, blkHeight, bpp;
+    formatInfo(formatType, blkWidth, blkHeight, bpp);
+    u32 blocksX = DIV_ROUND_UP(width, blkWidth), blocksY = DIV_ROUND_UP(height, blkHeight);
+    u32 outWidth = DIV_ROUND_UP(width, scale), outHeight = DIV_ROUND_UP(height, scale);
+    u32 channels = normal == NORMAL_RGB ? 3 : 4;
+    dst.resize((size_t)outWidth * outHeight * channels);
+
+    std::vector<u8> rows(outWidth * 4 * 2);
+    auto finishRow = [&](u8* row, u32 y) {
+        if (normal) reconstructNormalZ(row, outWidth);
+        u8* out = dst.data() + (size_t)y * outWidth * channels;
+        if (channels == 3) storePixelsRGB(row, out, outWidth);
+        else storePixels(map, row, out, outWidth, colorTable);
+        if (stats) stats->accumulate(channels == 3 ? row : out, outWidth);
+    };
+
+    if (blkWidth == 1) {
+        for (u32 y = 0; y < outHeight; y++) {
+            u32 sy = std::min(y * scale + scale / 2, height - 1);
+            for (u32 x = 0; x < outWidth; x++) {
+                u32 sx = std::min(x * scale + scale / 2, width - 1);
+                expandTexel(formatType, src.data() + ((size_t)sy * width + sx) * bpp, &rows[x * 4]);
+            }
+            finishRow(rows.data(), y);
+        }
+        return true;
+    }
+
+    if (scale == 2) {
+        u8 block[64];
+        for (u32 by = 0; by < blocksY; by++) {
+            for (u32 bx = 0; bx < blocksX; bx++) {
+                decodeBCBlock(formatType, isSigned, src.data() + ((size_t)by * blocksX + bx) * bpp, block);
+                for (u32 r = 0; r < 2; r++) {
+                    for (u32 c = 0; c < 2 && bx * 2 + c < outWidth; c++) {
+                        const u8* p = block + (r * 2 * 4 + c * 2) * 4;
+                        u8* o = &rows[(r * outWidth + bx * 2 + c) * 4];
+                        for (int ch = 0; ch < 4; ch++) o[ch] = (p[ch] + p[ch + 4] + p[ch + 16] + p[ch + 20] + 2) / 4;
+                    }
+                }
+            }
+            for (u32 r = 0; r < 2 && by * 2 + r < outHeight; r++) finishRow(&rows[r * outWidth * 4], by * 2 + r);
+        }
+        return true;
+    }
+
+    u32 span = scale / 4;
+    u8 average[4];
+    for (u32 y = 0; y < outHeight; y++) {
+        for (u32 x = 0; x < outWidth; x++) {
+            u32 sum[4] = {}, n = 0;
+            for (u32 by = y * span; by < std::min(blocksY, (y + 1) * span); by++) {
+                for (u32 bx = x * span; bx < std::min(blocksX, (x + 1) * span); bx++, n++) {
+                    averageBCBlock(formatType, isSigned, src.data() + ((size_t)by * blocksX + bx) * bpp, average);
+                    for (int c = 0; c < 4; c++) sum[c] += average[c];
+                }
+            }
+            for (int c = 0; c < 4; c++) rows[x * 4 + c] = (u8)((sum[c] + n / 2) / n);
+        }
+        finishRow(rows.data(), y);
+    }
+    return true;
+}
+
+// Decodes an untiled surface (rows of blocks, tightly packed) to RGBA8 with
+// the BRTI component selectors and any color table applied as each row or
+// block is stored. With a normal mode, BC5 Z is rebuilt on each decoded block
+// before it is stored and the selectors are ignored, since the output
+// channels are fixed as XYZ(1).
+bool decodeSurface(u32 format, u32 compSel, u32 width, u32 height, const SurfaceBuffer& src, SurfaceBuffer& dst,
+                   const SurfaceDecode& params = SurfaceDecode()) {
+    u32 formatType = format >> 8;
+    u32 blkWidth, blkHeight, bpp;
+    if (!canDecode(formatType) || !formatInfo(formatType, blkWidth, blkHeight, bpp)) return false;
+    u32 blocksX = DIV_ROUND_UP(width, blkWidth), blocksY = DIV_ROUND_UP(height, blkHeight);
+    if (src.size() < (u64)blocksX * blocksY * bpp) return false;
+
+    NormalMode normal = formatType == 0x1e ? params.normal : NORMAL_OFF;
+    const u8* colorTable = params.colorTable;
+    ChannelMap map = makeChannelMap(normal ? COMP_SEL_IDENTITY : compSel);
+    bool isSigned = (format & 0xFF) == 2;
+    u32 channels = normal == NORMAL_RGB ? 3 : 4;
+    if (params.scale > 1) {
+        bool decoded = decodeScaled(formatType, isSigned, map, width, height, src, dst,
+                                    params.scale, normal, colorTable, params.stats);
+        if (decoded && params.stats) params.stats->finish();
+        return decoded;
+    }
+    dst.resize((size_t)width * height * channels);
+
+    if (blkWidth == 1) {
+        std::vector<u8> row(width * 4);
+        for (u32 y = 0; y < height; y++) {
+            const u8* in = src.data() + (size_t)y * width * bpp;
+            u8* out = dst.data() + (size_t)y * width * 4;
+            if (formatType == 0x0b) {
+                storePixels(map, in, out, width, colorTable);
+            } else {
+                for (u32 x = 0; x < width; x++) expandTexel(formatType, in + x * bpp, &row[x * 4]);
+                storePixels(map, row.data(), out, width, colorTable);
+            }
+            if (params.stats) params.stats->accumulate(out, width);
+        }
+        if (params.stats) params.stats->finish();
+        return true;
+    }
+
+    // Statistics are taken once per strip of four pixel rows rather than per
+    // block row, so the kernels see whole rows. RGB output keeps its RGBA
+    // pixels for them in a strip of its own.
+    u8 block[64];
+    std::vector<u8> strip(params.stats && channels == 3 ? (size_t)width * 16 : 0);
+    for (u32 by = 0; by < blocksY; by++) {
+        u32 rows = std::min(4u, height - by * 4);
+        for (u32 bx = 0; bx < blocksX; bx++) {
+            decodeBCBlock(formatType, isSigned, src.data() + ((size_t)by * blocksX + bx) * bpp, block);
+            if (normal) reconstructNormalZ(block, 16);
+            u32 cols = std::min(4u, width - bx * 4);
+            for (u32 r = 0; r < rows; r++) {
+                u8* out = dst.data() + ((size_t)(by * 4 + r) * width + bx * 4) * channels;
+                if (channels == 3) storePixelsRGB(block + r * 16, out, cols);
+                else storePixels(map, block + r * 16, out, cols, colorTable);
+                if (!strip.empty()) std::memcpy(&strip[((size_t)r * width + bx * 4) * 4], block + r * 16, cols * 4);
+            }
+        }
+        if (params.stats) {
+            const u8* pixels = strip.empty() ? dst.data() + (size_t)by * 4 * width * 4 : strip.data();
+            params.stats->accumulate(pixels, width * rows);
+        }
+    }
+    if (params.stats) params.stats->finish();
+    return true;
+}
+
+// ============================================================================
+// SOLID TEXTURE DETECTION
+// ============================================================================
+
+// What a texture holds, judged from its blocks without decoding the surface.
+enum Content { CONTENT_VARIED, CONTENT_SOLID, CONTENT_EMPTY };
+
+// Skip solid and empty textures instead of writing them; set once from the
+// command line like verbose.
+bool skipSolidTextures = false;
+
+// True if every bpp-byte block of the surface equals the first one. The first
+// block is repeated across a 16-byte pattern (bpp divides 16) and the surface
+// is compared a vector at a time, stopping at the first difference.
+bool allBlocksEqual(const u8* data, size_t size, u32 bpp) {
+    if (size < bpp || 16 % bpp != 0) return false;
+    alignas(16) u8 pattern[16];
+    for (u32 i = 0; i < 16; i++) pattern[i] = data[i % bpp];
+
+    size_t i;
+    if (!kernels.blocksEqual(data, size, pattern, i)) return false;
+    for (; i < size; i++) {
+        if (data[i] != pattern[i % 16]) return false;
+    }
+    return true;
+}
+
+// Reads count bits starting at bit pos of a little-endian 128-bit block.
+inline u32 blockBits(const u8* block, u32 pos, u32 count) {
+    u32 v = 0;
+    for (u32 b = 0; b < count; b++, pos++) v |= ((block[pos / 8] >> (pos % 8)) & 1) << b;
+    return v;
+}
+
+// BC7 modes 5 and 6 are constant when both endpoints are equal, whatever the
+// indices say. Other modes are not recognised.
+bool bc7ConstantColor(const u8* block, u8* rgba) {
+    if ((block[0] & 0x7F) == 0x40) {
+        u32 e[2][4], p[2];
+        for (int c = 0; c < 4; c++) {
+            e[0][c] = blockBits(block, 7 + c * 14, 7);
+            e[1][c] = blockBits(block, 14 + c * 14, 7);
+        }
+        p[0] = blockBits(block, 63, 1);
+        p[1] = blockBits(block, 64, 1);
+        if (p[0] != p[1] || std::memcmp(e[0], e[1], sizeof(e[0])) != 0) return false;
+        for (int c = 0; c < 4; c++) rgba[c] = (u8)((e[0][c] << 1) | p[0]);
+        return true;
+    }
+    if ((block[0] & 0x3F) == 0x20) {
+        u32 rotation = blockBits(block, 6, 2);
+        u32 e[2][4];
+        for (int c = 0; c < 3; c++) {
+            e[0][c] = blockBits(block, 8 + c * 14, 7);
+            e[1][c] = blockBits(block, 15 + c * 14, 7);
+        }
+        e[0][3] = blockBits(block, 50, 8);
+        e[1][3] = blockBits(block, 58, 8);
+        if (std::memcmp(e[0], e[1], sizeof(e[0])) != 0) return false;
+        for (int c = 0; c < 3; c++) rgba[c] = (u8)((e[0][c] << 1) | (e[0][c] >> 6));
+        rgba[3] = (u8)e[0][3];
+        if (rotation) std::swap(rgba[3], rgba[rotation - 1]);
+        return true;
+    }
+    return false;
+}
+
+inline u8 halfToUnorm8(u16 h) {
+    if (h & 0x8000) return 0;
+    int exponent = (h >> 10) & 0x1F;
+    float v = exponent == 0 ? (h & 0x3FF) / 16777216.0f : std::ldexp(1.0f + (h & 0x3FF) / 1024.0f, exponent - 15);
+    return (u8)std::lrint(std::min(v, 1.0f) * 255.0f);
+}
+
+// ASTC void-extent blocks carry one constant color for the whole block:
+// UNORM16 channels, or FP16 when the HDR bit is set.
+bool astcConstantColor(const u8* block, u8* rgba) {
+    if ((Read16LE(block) & 0x1FF) != 0x1FC) return false;
+    bool hdr = (block[1] >> 1) & 1;
+    for (int c = 0; c < 4; c++) {
+        u16 v = Read16LE(block + 8 + c * 2);
+        rgba[c] = hdr ? halfToUnorm8(v) : (u8)(v >> 8);
+    }
+    return true;
+}
+
+// Classifies an untiled surface and, if it is constant, returns its color
+// with the component selectors applied. Only the first block is ever decoded.
+Content classifySurface(u32 format, u32 compSel, u32 width, u32 height, const SurfaceBuffer& surface, u8* color) {
+    u32 formatType = format >> 8;
+    u32 blkWidth, blkHeight, bpp;
+    if (!formatInfo(formatType, blkWidth, blkHeight, bpp)) return CONTENT_VARIED;
+    size_t size = (size_t)DIV_ROUND_UP(width, blkWidth) * DIV_ROUND_UP(height, blkHeight) * bpp;
+    if (size == 0 || surface.size() < size || !allBlocksEqual(surface.data(), size, bpp)) return CONTENT_VARIED;
+
+    const u8* block = surface.data();
+    u8 rgba[64];
+    if (blkWidth == 1) {
+        expandTexel(formatType, block, rgba);
+    } else if (formatType >= 0x1a && formatType <= 0x1e) {
+        decodeBCBlock(formatType, (format & 0xFF) == 2, block, rgba);
+        // Edge texels outside a smaller-than-block texture do not count.
+        for (u32 i = 1; i < 16; i++) {
+            if (i % 4 < width && i / 4 < height && std::memcmp(rgba, rgba + i * 4, 4) != 0) return CONTENT_VARIED;
+        }
+    } else if (formatType == 0x20) {
+        if (!bc7ConstantColor(block, rgba)) return CONTENT_VARIED;
+    } else if (formatType >= 0x2d && formatType <= 0x3a) {
+        if (!astcConstantColor(block, rgba)) return CONTENT_VARIED;
+    } else {
+        return CONTENT_VARIED;
+    }
+
+    storePixels(makeChannelMap(compSel), rgba, color, 1);
+    return color[3] == 0 ? CONTENT_EMPTY : CONTENT_SOLID;
+}
+
+// ============================================================================
+// MIP GENERATION
+// ============================================================================
+
+// Set by --gen-mips: give decoded output a full mip chain down to 1x1.
+bool generateMipChain = false;
+
+// sRGB to 16-bit linear, and 12-bit linear back to sRGB, for averaging in
+// linear light. The reverse table is indexed by the truncated 12-bit value
+// and built at the bin centers.
+const u16* srgbToLinear16Table() {
+    static const std::vector<u16> table = [] {
+        std::vector<u16> t(256);
+        for (int i = 0; i < 256; i++) {
+            double c = i / 255.0;
+            double l = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+            t[i] = (u16)std::lround(l * 65535.0);
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+const u8* linear12ToSrgbTable() {
+    static const std::vector<u8> table = [] {
+        std::vector<u8> t(4096);
+        for (int i = 0; i < 4096; i++) {
+            double l = (i + 0.5) / 4096.0;
+            double c = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+            t[i] = (u8)std::lround(c * 255.0);
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+// Box-filters rows [y0, y1) of the next level. Levels round down like D3D, so
+// an odd last row or column is dropped; a dimension of 1 averages with itself.
+void downsampleRows(const u8* src, u32 sw, u32 sh, u8* dst, u32 dw, u32 y0, u32 y1, u32 bpp) {
+    for (u32 y = y0; y < y1; y++) {
+        const u8* r0 = src + (size_t)std::min(2 * y, sh - 1) * sw * bpp;
+        const u8* r1 = src + (size_t)std::min(2 * y + 1, sh - 1) * sw * bpp;
+        u8* out = dst + (size_t)y * dw * bpp;
+        u32 x = 0;
+        if (bpp == 4) x = kernels.boxFilterRGBA(r0, r1, out, sw / 2);
+        for (; x < dw; x++) {
+            u32 x0 = std::min(2 * x, sw - 1) * bpp;
+            u32 x1 = std::min(2 * x + 1, sw - 1) * bpp;
+            for (u32 c = 0; c < bpp; c++) {
+                out[x * bpp + c] = (u8)((r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c] + 2) >> 2);
+            }
+        }
+    }
+}
+
+// Same for sRGB data: color is averaged in linear light, alpha as stored.
+// Scalar, since every texel goes through two table lookups.
+void downsampleRowsSRGB(const u8* src, u32 sw, u32 sh, u8* dst, u32 dw, u32 y0, u32 y1, u32 bpp) {
+    const u16* toLinear = srgbToLinear16Table();
+    const u8* toSRGB = linear12ToSrgbTable();
+    for (u32 y = y0; y < y1; y++) {
+        const u8* r0 = src + (size_t)std::min(2 * y, sh - 1) * sw * bpp;
+        const u8* r1 = src + (size_t)std::min(2 * y + 1, sh - 1) * sw * bpp;
+        u8* out = dst + (size_t)y * dw * bpp;
+        for (u32 x = 0; x < dw; x++) {
+            u32 x0 = std::min(2 * x, sw - 1) * bpp;
+            u32 x1 = std::min(2 * x + 1, sw - 1) * bpp;
+            for (u32 c = 0; c < 3; c++) {
+                u32 sum = toLinear[r0[x0 + c]] + toLinear[r0[x1 + c]] + toLinear[r1[x0 + c]] + toLinear[r1[x1 + c]];
+                out[x * bpp + c] = toSRGB[sum >> 6];
+            }
+            if (bpp == 4) out[x * bpp + 3] = (u8)((r0[x0 + 3] + r0[x1 + 3] + r1[x0 + 3] + r1[x1 + 3] + 2) >> 2);
+        }
+    }
+}
+
+// Cleared on batch worker threads: they already keep every core busy, so a
+// level there is generated on the calling thread instead of spawning more.
+thread_local bool tileMipsOverThreads = true;
+
+// Runs fn(begin, end) over tiles of [0, rows), spread over threads once a
+// level is big enough to pay for them.
+template <typename Fn>
+void forEachRowTile(u32 rows, size_t bytes, Fn fn) {
+    const size_t minTileBytes = 256 * 1024;
+    if (!tileMipsOverThreads) {
+        fn(0u, rows);
+        return;
+    }
+    size_t tiles = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), rows);
+    tiles = std::min(tiles, bytes / minTileBytes);
+    if (tiles <= 1) {
+        fn(0u, rows);
+        return;
+    }
+    u32 perTile = DIV_ROUND_UP(rows, (u32)tiles);
+    std::vector<std::thread> threads;
+    for (u32 begin = perTile; begin < rows; begin += perTile) {
+        threads.emplace_back(fn, begin, std::min(rows, begin + perTile));
+    }
+    fn(0u, perTile);
+    for (auto& t : threads) t.join();
+}
+
+// Appends every smaller level to a width x height surface of bpp-byte pixels
+// and returns the size of each level, the top one first.
+std::vector<u32> generateMips(SurfaceBuffer& surface, u32 width, u32 height, u32 bpp, bool srgb) {
+    std::vector<u32> sizes(1, width * height * bpp);
+    size_t total = sizes[0];
+    for (u32 w = width, h = height; (w > 1 || h > 1) && sizes.size() < texpack::MAX_MIPS;) {
+        w = std::max(1u, w / 2);
+        h = std::max(1u, h / 2);
+        sizes.push_back(w * h * bpp);
+        total += sizes.back();
+    }
+    surface.resize(total);
+
+    size_t offset = 0;
+    for (size_t level = 1; level < sizes.size(); level++) {
+        const u8* src = surface.data() + offset;
+        u8* dst = surface.data() + offset + sizes[level - 1];
+        u32 dw = std::max(1u, width / 2);
+        u32 dh = std::max(1u, height / 2);
+        forEachRowTile(dh, sizes[level], [=](u32 y0, u32 y1) {
+            if (srgb) downsampleRowsSRGB(src, width, height, dst, dw, y0, y1, bpp);
+            else downsampleRows(src, width, height, dst, dw, y0, y1, bpp);
+        });
+        offset += sizes[level - 1];
+        width = dw;
+        height = dh;
+    }
+    return sizes;
+}
+
+// ============================================================================
+// BNTX VIEWS
+// ============================================================================
+
+// Typed views of the structures in a BNTX image, read in place. bind() is the
+// only check: it makes sure the whole structure lies inside the buffer, after
+// which every accessor is one unaligned load (plus bswap for big endian).
+// Pointer fields are returned as stored; callers bind the structure they lead to.
+template <typename Order, u32 Size>
+struct StructView {
+    static constexpr u32 SIZE = Size;
+    const u8* p = nullptr;
+
+    [[nodiscard]] bool bind(const u8* data, u64 size, i64 addr) {
+        if (addr < 0 || (u64)addr > size || size - (u64)addr < Size) return false;
+        p = data + addr;
+        return true;
+    }
+    bool magicIs(const char* magic) const { return std::memcmp(p, magic, 4) == 0; }
+
+    u8 u8At(u32 offset) const { return p[offset]; }
+    u16 u16At(u32 offset) const { return Order::read16(p + offset); }
+    u32 u32At(u32 offset) const { return Order::read32(p + offset); }
+    i64 ptrAt(u32 offset) const { return Order::read64Signed(p + offset); }
+};
+
+// File header at 0; the BOM at 0xC is what picked Order.
+template <typename Order>
+struct BNTXHeaderView : StructView<Order, 0x20> {
+    u32 version() const { return this->u32At(0x08); }
+    u8 alignmentShift() const { return this->u8At(0x0E); }
+    u32 fileNameAddr() const { return this->u32At(0x10); }    // chars of a _STR entry
+    u16 firstBlockAddr() const { return this->u16At(0x16); }
+    u32 relocAddr() const { return this->u32At(0x18); }
+    u32 fileSize() const { return this->u32At(0x1C); }
+};
+
+// NX container header at 0x20.
+template <typename Order>
+struct NXView : StructView<Order, 0x28> {
+    u32 textureCount() const { return this->u32At(0x04); }
+    i64 infoPtrsAddr() const { return this->ptrAt(0x08); }    // textureCount BRTI pointers
+    i64 dataBlockAddr() const { return this->ptrAt(0x10); }   // BRTD
+    i64 dictAddr() const { return this->ptrAt(0x18); }        // _DIC of texture names
+    u32 stringDictSize() const { return this->u32At(0x20); }
+};
+
+// Texture info. Only the first 0x78 bytes are read, so that is all bind() asks for.
+template <typename Order>
+struct BRTIView : StructView<Order, 0x78> {
+    u8 tileMode() const { return this->u8At(0x10); }
+    u16 flags() const { return this->u16At(0x12); }
+    u16 swizzle() const { return this->u16At(0x14); }
+    u16 mipCount() const { return this->u16At(0x16); }
+    u32 format() const { return this->u32At(0x1C); }
+    u32 width() const { return this->u32At(0x24); }
+    u32 height() const { return this->u32At(0x28); }
+    u32 depth() const { return this->u32At(0x2C); }
+    u32 arrayLength() const { return this->u32At(0x30); }
+    u32 sizeRange() const { return this->u32At(0x34); }
+    u32 imageSize() const { return this->u32At(0x50); }
+    u32 alignment() const { return this->u32At(0x54); }
+    u32 compSel() const { return Read32LE(this->p + 0x58); }  // four u8 selectors, not a word
+    i64 nameAddr() const { return this->ptrAt(0x60); }        // _STR entry
+    i64 mipPtrsAddr() const { return this->ptrAt(0x70); }     // mipCount data pointers
+};
+
+// Texture data block header; payloads follow it.
+template <typename Order>
+struct BRTDView : StructView<Order, 0x10> {
+    i64 blockSize() const { return this->ptrAt(0x08); }
+};
+
+// A length-prefixed, NUL-terminated name as stored in _STR. The view covers
+// the prefix; name() checks that the characters fit as well.
+template <typename Order>
+struct StringEntryView : StructView<Order, 2> {
+    u16 length() const { return this->u16At(0); }
+    [[nodiscard]] bool name(const u8* data, u64 size, std::string_view& out) const {
+        u64 chars = (u64)(this->p - data) + 2;
+        if (length() > size - chars) return false;
+        out = std::string_view(reinterpret_cast<const char*>(this->p + 2), length());
+        return true;
+    }
+    // Entries are padded to 2 bytes after the terminator.
+    u32 storedSize() const { return (2 + length() + 1 + 1) & ~1u; }
+};
+
+// String pool: stringCount() entries follow an empty one at 0x14.
+template <typename Order>
+struct StringTableView : StructView<Order, 0x14> {
+    u32 blockSize() const { return this->u32At(0x08); }
+    u32 stringCount() const { return this->u32At(0x10); }
+};
+
+// Name dictionary (a Patricia trie over the texture names). count() + 1 nodes
+// of 16 bytes follow the header, the first being the root; nodes 1..count()
+// hold the names in texture order.
+template <typename Order>
+struct DictView : StructView<Order, 0x08> {
+    static constexpr u32 NODE_SIZE = 0x10;
+
+    // Binds the header, then checks that every node fits too.
+    bool bindNodes(const u8* data, u64 size, i64 addr) {
+        if (!this->bind(data, size, addr)) return false;
+        u64 nodes = (u64)count() + 1;
+        return nodes * NODE_SIZE <= size - (u64)addr - this->SIZE;
+    }
+    u32 count() const { return this->u32At(0x04); }
+    u32 refBit(u32 node) const { return this->u32At(0x08 + node * NODE_SIZE); }
+    u16 left(u32 node) const { return this->u16At(0x0C + node * NODE_SIZE); }
+    u16 right(u32 node) const { return this->u16At(0x0E + node * NODE_SIZE); }
+    i64 keyAddr(u32 node) const { return this->ptrAt(0x10 + node * NODE_SIZE); }    // _STR entry
+};
+
+// Relocation table header at the file header's relocAddr; sectionCount()
+// sections follow it, then the entries of all sections.
+template <typename Order>
+struct RelocTableView : StructView<Order, 0x10> {
+    u32 position() const { return this->u32At(0x04); }
+    u32 sectionCount() const { return this->u32At(0x08); }
+};
+
+template <typename Order>
+struct RelocSectionView : StructView<Order, 0x18> {
+    i64 basePtr() const { return this->ptrAt(0x00); }        // runtime only
+    u32 position() const { return this->u32At(0x08); }
+    u32 size() const { return this->u32At(0x0C); }
+    u32 entryIndex() const { return this->u32At(0x10); }
+    u32 entryCount() const { return this->u32At(0x14); }
+};
+
+// structCount runs of offsetCount consecutive pointers starting at position(),
+// each run followed by paddingCount skipped pointer slots.
+template <typename Order>
+struct RelocEntryView : StructView<Order, 0x08> {
+    u32 position() const { return this->u32At(0x00); }
+    u16 structCount() const { return this->u16At(0x04); }
+    u8 offsetCount() const { return this->u8At(0x06); }
+    u8 paddingCount() const { return this->u8At(0x07); }
+};
+
+// ============================================================================
+// BNTX PARSER
+// ============================================================================
+
+// Byte order from the BOM at 0xC; false if it is neither FF FE nor FE FF.
+bool readByteOrder(const u8* head, bool& bigEndian) {
+    if (head[0xc] == 0xFF && head[0xd] == 0xFE) bigEndian = false;
+    else if (head[0xc] == 0xFE && head[0xd] == 0xFF) bigEndian = true;
+    else return false;
+    return true;
+}
+
+// Copies a BRTI's fields into tex; name, data and dataOffset are left to the caller.
+template <typename Order>
+void readTextureInfo(const BRTIView<Order>& brti, BNTXTexture& tex) {
+    tex.width = brti.width();
+    tex.height = brti.height();
+    tex.format = brti.format();
+    tex.tileMode = brti.tileMode();
+    tex.sizeRange = brti.sizeRange();
+    tex.alignment = brti.alignment();
+    tex.imageSize = brti.imageSize();
+    tex.compSel = brti.compSel();
+}
+
+// Field parsing for one byte order; the BNTX magic and size are already checked.
+template <typename Order>
+std::vector<BNTXTexture> parseBNTXFields(const FileBuffer& f, bool copyData, u64 dataLimit) {
+    std::vector<BNTXTexture> textures;
+    const u8* data = f.data();
+    u64 size = f.size();
+    
+    BNTXHeaderView<Order> header;
+    if (!header.bind(data, size, 0)) {
+        std::cerr << "File too small!" << std::endl;
+        return textures;
+    }
+    
+    if (verbose) {
+        std::string_view fileName;
+        StringEntryView<Order> entry;
+        bool named = header.fileNameAddr() >= 2 && entry.bind(data, size, (i64)header.fileNameAddr() - 2) &&
+                     entry.name(data, size, fileName);
+        std::cout << "File name: " << (named ? fileName : std::string_view("(invalid)")) << std::endl;
+        std::cout << "File size: " << header.fileSize() << std::endl;
+    }
+    
+    NXView<Order> nx;
+    if (!nx.bind(data, size, 0x20) || !nx.magicIs("NX  ")) {
+        std::cerr << "Invalid NX header!" << std::endl;
+        return textures;
+    }
+    
+    u32 texCount = nx.textureCount();
+    i64 infoPtrAddr = nx.infoPtrsAddr();
+    
+    if (verbose) std::cout << "Textures count: " << texCount << std::endl;
+    if (infoPtrAddr >= 0 && (u64)infoPtrAddr < size) {
+        textures.reserve(std::min<u64>(texCount, (size - infoPtrAddr) / 8));
+    }
+    
+    for (u32 i = 0; i < texCount; i++) {
+        StructView<Order, 8> infoPtr;
+        if (!infoPtr.bind(data, size, infoPtrAddr + (i64)i * 8)) {
+            std::cerr << "Invalid texture info pointer!" << std::endl;
+            break;
+        }
+        
+        BRTIView<Order> brti;
+        if (!brti.bind(data, size, infoPtr.ptrAt(0))) {
+            std::cerr << "Invalid texture info address!" << std::endl;
+            continue;
+        }
+        
+        if (!brti.magicIs("BRTI")) {
+            std::cerr << "Invalid BRTI magic!" << std::endl;
+            continue;
+        }
+        
+        StringEntryView<Order> nameEntry;
+        StructView<Order, 8> mipPtrs;
+        std::string_view name;
+        if (!nameEntry.bind(data, size, brti.nameAddr()) || !mipPtrs.bind(data, size, brti.mipPtrsAddr())) {
+            std::cerr << "Invalid name or mip pointer!" << std::endl;
+            continue;
+        }
+        if (!nameEntry.name(data, size, name)) {
+            std::cerr << "Invalid name!" << std::endl;
+            continue;
+        }
+        name = name.substr(0, name.find('\0'));
+        
+        u32 imageSize = brti.imageSize();
+        
+        if (verbose) {
+            std::cout << "\n=== Image " << (i+1) << " ===" << std::endl;
+            std::cout << "Name: " << name << std::endl;
+            std::cout << "Width: " << brti.width() << std::endl;
+            std::cout << "Height: " << brti.height() << std::endl;
+            
+            auto fmtIt = formats.find(brti.format());
+            if (fmtIt != formats.end()) {
+                std::cout << "Format: " << fmtIt->second << std::endl;
+            } else {
+                std::cout << "Format: 0x" << std::hex << brti.format() << std::dec << std::endl;
+            }
+            
+            std::cout << "TileMode: " << (brti.tileMode() == 0 ? "LINEAR" : "BLOCK_LINEAR") << std::endl;
+            std::cout << "Block Height: " << (1 << brti.sizeRange()) << std::endl;
+            std::cout << "Image Size: " << imageSize << std::endl;
+            std::cout << "Channels: " << compSelName(brti.compSel()) << std::endl;
+        }
+        
+        i64 dataAddr = mipPtrs.ptrAt(0);
+        
+        if (dataAddr < 0 || (u64)dataAddr + imageSize > dataLimit) {
+            std::cerr << "Invalid data address!" << std::endl;
+            continue;
+        }
+        
+        BNTXTexture& tex = textures.emplace_back();
+        tex.name = name;
+        readTextureInfo(brti, tex);
+        tex.dataOffset = dataAddr;
+        if (copyData) {
+            tex.data.resize(imageSize);
+            std::memcpy(tex.data.data(), &data[dataAddr], imageSize);
+        }
+    }
+    
+    return textures;
+}
+
+// With copyData false only dataOffset is filled in, so the caller can copy each
+// texture's span when it is ready to process it. dataLimit is the real file
+// size when f only holds the leading metadata (everything before BRTD).
+std::vector<BNTXTexture> parseBNTX(const FileBuffer& f, bool copyData = true, u64 dataLimit = 0) {
+    if (dataLimit == 0 || copyData) dataLimit = f.size();
+    
+    if (f.size() < 0x100) {
+        std::cerr << "File too small!" << std::endl;
+        return {};
+    }
+   
+    if (std::memcmp(&f[0], "BNTX", 4) != 0) {
+        std::cerr << "Not a valid BNTX file!" << std::endl;
+        return {};
+    }
+    
+    bool bigEndian;
+    if (!readByteOrder(&f[0], bigEndian)) {
+        std::cerr << "Invalid byte order mark!" << std::endl;
+        return {};
+    }
+    
+    if (verbose) std::cout << "BNTX file detected" << (bigEndian ? " (big endian)" : "") << std::endl;
+    
+    if (bigEndian) return parseBNTXFields<BigEndian>(f, copyData, dataLimit);
+    return parseBNTXFields<LittleEndian>(f, copyData, dataLimit);
+}
+
+// ============================================================================
+// RELOCATION TABLE
+// ============================================================================
+
+// Every pointer field of a BNTX file is listed in its _RLT block. Expanded once,
+// the list lets all pointers be checked in one pass and an image be moved to
+// a new base without knowing any structure layout.
+struct Relocations {
+    bool bigEndian = false;
+    std::vector<u64> fields;    // file offsets of 8-byte pointer fields, ascending
+};
+
+const u64 POINTER_SIZE = 8;
+
+template <typename Order>
+bool expandRelocations(const u8* data, u64 size, std::vector<u64>& fields, std::string& error) {
+    BNTXHeaderView<Order> header;
+    RelocTableView<Order> table;
+    if (!header.bind(data, size, 0) || header.relocAddr() == 0 ||
+        !table.bind(data, size, header.relocAddr()) || !table.magicIs("_RLT")) {
+        error = "no relocation table";
+        return false;
+    }
+
+    u64 sectionsAddr = header.relocAddr() + table.SIZE;
+    u64 entriesAddr = sectionsAddr + (u64)table.sectionCount() * RelocSectionView<Order>::SIZE;
+    if (entriesAddr > size) {
+        error = "relocation sections out of range";
+        return false;
+    }
+
+    fields.clear();
+    for (u32 s = 0; s < table.sectionCount(); s++) {
+        RelocSectionView<Order> section;
+        if (!section.bind(data, size, sectionsAddr + (u64)s * section.SIZE)) {
+            error = "relocation section out of range";
+            return false;
+        }
+        u64 sectionEnd = (u64)section.position() + section.size();
+        if (sectionEnd > size) {
+            error = "relocation section out of range";
+            return false;
+        }
+        // Entries must ascend without overlapping, and a section cannot list
+        // more pointers than it has slots; both are checked before expanding,
+        // so a crafted table cannot make the list larger than the section.
+        u64 maxFields = section.size() / POINTER_SIZE, sectionFields = 0;
+        u64 previousEnd = section.position();
+        for (u32 e = 0; e < section.entryCount(); e++) {
+            RelocEntryView<Order> entry;
+            if (!entry.bind(data, size, entriesAddr + ((u64)section.entryIndex() + e) * entry.SIZE)) {
+                error = "relocation entry out of range";
+                return false;
+            }
+            u64 stride = ((u64)entry.offsetCount() + entry.paddingCount()) * POINTER_SIZE;
+            u64 pos = entry.position();
+            u64 end = entry.structCount() == 0 ? pos :
+                      pos + (entry.structCount() - 1) * stride + entry.offsetCount() * POINTER_SIZE;
+            if (pos < section.position() || end > sectionEnd) {
+                error = "relocated pointer outside its section";
+                return false;
+            }
+            if (pos < previousEnd) {
+                error = "overlapping relocation entries";
+                return false;
+            }
+            sectionFields += (u64)entry.structCount() * entry.offsetCount();
+            if (sectionFields > maxFields) {
+                error = "relocation section lists more pointers than it holds";
+                return false;
+            }
+            previousEnd = std::max(previousEnd, end);
+            for (u32 run = 0; run < entry.structCount(); run++, pos += stride) {
+                for (u32 k = 0; k < entry.offsetCount(); k++) fields.push_back(pos + k * POINTER_SIZE);
+            }
+        }
+    }
+    return true;
+}
+
+// Expands the _RLT of a whole file in memory; false with error set if it is
+// missing or inconsistent. The fields come back sorted, each listed once and
+// inside the file.
+bool readRelocations(const u8* data, u64 size, Relocations& relocs, std::string& error) {
+    if (size < 0x20 || !readByteOrder(data, relocs.bigEndian)) {
+        error = "invalid byte order mark";
+        return false;
+    }
+    try {
+        bool ok = relocs.bigEndian ? expandRelocations<BigEndian>(data, size, relocs.fields, error)
+                                   : expandRelocations<LittleEndian>(data, size, relocs.fields, error);
+        if (!ok) return false;
+    } catch (const std::bad_alloc&) {
+        relocs.fields = std::vector<u64>();
+        error = "relocation table too large";
+        return false;
+    }
+    // A field listed twice (say by overlapping sections) would be rebased twice.
+    std::sort(relocs.fields.begin(), relocs.fields.end());
+    if (std::adjacent_find(relocs.fields.begin(), relocs.fields.end()) != relocs.fields.end()) {
+        error = "pointer listed twice in relocation table";
+        return false;
+    }
+    return true;
+}
+
+// Index of the first listed pointer that does not point into the file, or
+// fields.size() if all do. The check is a branch-free OR over the whole list;
+// only a bad file pays for the second pass that finds the culprit.
+template <typename Order>
+size_t findBadPointerAs(const u8* data, u64 size, const std::vector<u64>& fields) {
+    u64 bad = 0;
+    for (u64 field : fields) bad |= Order::read64(data + field) >= size;
+    if (!bad) return fields.size();
+    size_t i = 0;
+    while (Order::read64(data + fields[i]) < size) i++;
+    return i;
+}
+
+size_t findBadPointer(const u8* data, u64 size, const Relocations& relocs) {
+    if (relocs.bigEndian) return findBadPointerAs<BigEndian>(data, size, relocs.fields);
+    return findBadPointerAs<LittleEndian>(data, size, relocs.fields);
+}
+
+// Adds delta to every relocated pointer of a host-order image: rebasing by the
+// buffer's address turns file offsets into real pointers, rebasing by its
+// negation turns them back.
+void relocate(u8* data, const std::vector<u64>& fields, u64 delta) {
+    for (u64 field : fields) {
+        u64 v;
+        std::memcpy(&v, data + field, POINTER_SIZE);
+        v += delta;
+        std::memcpy(data + field, &v, POINTER_SIZE);
+    }
+}
+
+using HostOrder = ByteOrder<HOST_BIG_ENDIAN>;
+
+// A BNTX file loaded once and rebased to the address it lives at, for
+// in-process use: NX, BRTI, name and mip pointers are real pointers and are
+// followed without translating or re-checking any field. load() checks the
+// relocation table, every pointer in it and every structure reachable from the
+// texture list, so the accessors need no checks. Only files in the host's
+// byte order can be rebased.
+class BNTXImage {
+public:
+    BNTXImage() = default;
+    BNTXImage(const BNTXImage&) = delete;
+    BNTXImage& operator=(const BNTXImage&) = delete;
+
+    bool load(FileBuffer&& file, std::string& error) {
+        image = std::move(file);
+        const u8* data = image.data();
+        u64 size = image.size();
+        Relocations relocs;
+        if (size < 0x100 || std::memcmp(data, "BNTX", 4) != 0) {
+            error = "not a BNTX file";
+            return false;
+        }
+        if (!readRelocations(data, size, relocs, error)) return false;
+        if (relocs.bigEndian != HOST_BIG_ENDIAN) {
+            error = "byte order differs from the host's";
+            return false;
+        }
+        size_t bad = findBadPointer(data, size, relocs);
+        if (bad != relocs.fields.size()) {
+            std::ostringstream msg;
+            msg << "pointer at 0x" << std::hex << relocs.fields[bad] << " out of range";
+            error = msg.str();
+            return false;
+        }
+        if (!checkTextures(relocs.fields, error)) return false;
+
+        relocate(image.data(), relocs.fields, (u64)(uintptr_t)image.data());
+        return true;
+    }
+
+    u32 textureCount() const { return nx().textureCount(); }
+
+    BRTIView<HostOrder> texture(u32 i) const {
+        BRTIView<HostOrder> brti;
+        brti.p = follow(follow(image.data() + 0x20 + 0x08) + i * POINTER_SIZE);
+        return brti;
+    }
+
+    static std::string_view name(const BRTIView<HostOrder>& brti) {
+        const u8* entry = follow(brti.p + 0x60);
+        return std::string_view(reinterpret_cast<const char*>(entry + 2), HostOrder::read16(entry));
+    }
+
+    // Start of the texture's first mip; imageSize() bytes of data follow.
+    static const u8* data(const BRTIView<HostOrder>& brti) {
+        return follow(follow(brti.p + 0x70));
+    }
+
+private:
+    FileBuffer image;
+
+    NXView<HostOrder> nx() const {
+        NXView<HostOrder> view;
+        view.p = image.data() + 0x20;
+        return view;
+    }
+
+    static const u8* follow(const u8* field) {
+        return reinterpret_cast<const u8*>((uintptr_t)HostOrder::read64(field));
+    }
+
+    // The pointers load() follows on behalf of the accessors must be relocated
+    // and lead to structures that fit.
+    bool checkTextures(const std::vector<u64>& sorted, std::string& error) const {
+        const u8* data = image.data();
+        u64 size = image.size();
+        auto listed = [&](u64 field) { return std::binary_search(sorted.begin(), sorted.end(), field); };
+
+        NXView<HostOrder> header;
+        if (!header.bind(data, size, 0x20) || !header.magicIs("NX  ") || !listed(0x20 + 0x08)) {
+            error = "invalid NX header";
+            return false;
+        }
+        for (u32 i = 0; i < header.textureCount(); i++) {
+            u64 infoPtr = (u64)header.infoPtrsAddr() + (u64)i * POINTER_SIZE;
+            BRTIView<HostOrder> brti;
+            StringEntryView<HostOrder> nameEntry;
+            StructView<HostOrder, 8> mipPtrs;
+            std::string_view name;
+            if (!listed(infoPtr) || !brti.bind(data, size, HostOrder::read64Signed(data + infoPtr)) ||
+                !brti.magicIs("BRTI")) {
+                error = "invalid texture info pointer";
+                return false;
+            }
+            u64 brtiAddr = brti.p - data;
+            if (!listed(brtiAddr + 0x60) || !nameEntry.bind(data, size, brti.nameAddr()) ||
+                !nameEntry.name(data, size, name) || !listed(brtiAddr + 0x70) ||
+                !mipPtrs.bind(data, size, brti.mipPtrsAddr()) || !listed((u64)brti.mipPtrsAddr())) {
+                error = "invalid name or mip pointer";
+                return false;
+            }
+            if ((u64)mipPtrs.ptrAt(0) + brti.imageSize() > size) {
+                error = "invalid data address";
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// ============================================================================
+// PROGRESS REPORTING
+// ============================================================================
+
+// Counters shared by all workers. Updates are relaxed atomic adds, cheap enough
+// to stay on unconditionally; the reporter thread only samples them.
+struct Progress {
+    std::atomic<u64> filesTotal{0};
+    std::atomic<u64> filesDone{0};
+    std::atomic<u64> filesFailed{0};
+    std::atomic<u64> texturesDone{0};
+    std::atomic<u64> bytesTotal{0};
+    std::atomic<u64> bytesIn{0};
+    std::atomic<u64> bytesOut{0};
+};
+
+Progress progress;
+
+void resetProgress() {
+    for (auto* counter : {&progress.filesTotal, &progress.filesDone, &progress.filesFailed, &progress.texturesDone,
+                          &progress.bytesTotal, &progress.bytesIn, &progress.bytesOut}) {
+        counter->store(0);
+    }
+}
+
+// What one worker is busy with, so the reporter can name the slowest in-flight item.
+struct WorkerSlot {
+    std::mutex lock;
+    std::string item;
+    std::chrono::steady_clock::time_point start;
+    bool busy = false;
+
+    void begin(const std::string& name) {
+        std::lock_guard<std::mutex> guard(lock);
+        item = name;
+        start = std::chrono::steady_clock::now();
+        busy = true;
+    }
+
+    void end() {
+        std::lock_guard<std::mutex> guard(lock);
+        busy = false;
+    }
+};
+
+std::string formatDuration(double seconds) {
+    u64 s = (u64)seconds;
+    std::ostringstream ss;
+    if (s >= 3600) ss << s / 3600 << "h" << std::setw(2) << std::setfill('0') << (s / 60) % 60 << "m";
+    else if (s >= 60) ss << s / 60 << "m" << std::setw(2) << std::setfill('0') << s % 60 << "s";
+    else ss << std::fixed << std::setprecision(1) << seconds << "s";
+    return ss.str();
+}
+
+// Runs a callback at a fixed interval, either on its own thread or from the
+// owner's loop via tick() for callers that must stay single-threaded (the
+// forked worker pool).
+class PeriodicTask {
+public:
+    PeriodicTask(std::chrono::milliseconds interval, std::function<void()> fn)
+        : interval(interval), fn(std::move(fn)) {}
+
+    ~PeriodicTask() { stop(); }
+
+    void start() {
+        startManual();
+        thread = std::thread([this] { run(); });
+    }
+
+    void startManual() {
+        lastRun = std::chrono::steady_clock::now();
+        active = true;
+    }
+
+    void tick() {
+        if (!active) return;
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastRun >= interval) {
+            lastRun = now;
+            fn();
+        }
+    }
+
+    // Returns whether the task was running; the callback is not invoked again.
+    bool stop() {
+        if (!active) return false;
+        active = false;
+        if (thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            wake.notify_all();
+            thread.join();
+        }
+        return true;
+    }
+
+private:
+    std::chrono::milliseconds interval;
+    std::function<void()> fn;
+    bool active = false;
+    std::chrono::steady_clock::time_point lastRun;
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void run() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (!wake.wait_for(guard, interval, [this] { return stopping; })) {
+            guard.unlock();
+            fn();
+            guard.lock();
+        }
+    }
+};
+
+class ProgressReporter {
+public:
+    ProgressReporter(std::vector<std::unique_ptr<WorkerSlot>>& slots, std::chrono::milliseconds interval)
+        : slots(slots), tty(isatty(fileno(stderr)) != 0), task(interval, [this] { report(false); }) {}
+
+    ~ProgressReporter() { stop(); }
+
+    void start() {
+        begin = std::chrono::steady_clock::now();
+        task.start();
+    }
+
+    void startManual() {
+        begin = std::chrono::steady_clock::now();
+        task.startManual();
+    }
+
+    void tick() { task.tick(); }
+
+    void stop() {
+        if (task.stop()) report(true);
+    }
+
+private:
+    std::vector<std::unique_ptr<WorkerSlot>>& slots;
+    bool tty;
+    std::chrono::steady_clock::time_point begin;
+    PeriodicTask task;
+
+    void report(bool final) {
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - begin).count();
+        if (elapsed <= 0) elapsed = 1e-9;
+
+        u64 filesDone = progress.filesDone.load(std::memory_order_relaxed);
+        u64 filesTotal = progress.filesTotal.load(std::memory_order_relaxed);
+        u64 textures = progress.texturesDone.load(std::memory_order_relaxed);
+        u64 bytesIn = progress.bytesIn.load(std::memory_order_relaxed);
+        u64 bytesTotal = progress.bytesTotal.load(std::memory_order_relaxed);
+        u64 bytesOut = progress.bytesOut.load(std::memory_order_relaxed);
+
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(1)
+             << "[" << filesDone << "/" << filesTotal << " files] "
+             << textures / elapsed << " tex/s, "
+             << bytesIn / elapsed / (1024.0 * 1024.0) << " MB/s in, "
+             << bytesOut / elapsed / (1024.0 * 1024.0) << " MB/s out";
+
+        if (final) {
+            line << ", " << textures << " textures in " << formatDuration(elapsed);
+            u64 failed = progress.filesFailed.load(std::memory_order_relaxed);
+            if (failed) line << ", " << failed << " failed";
+        } else {
+            // ETA from input bytes, which tracks work far better than file count
+            if (bytesIn > 0 && bytesTotal > bytesIn) {
+                line << ", ETA " << formatDuration(elapsed * (bytesTotal - bytesIn) / bytesIn);
+            }
+
+            std::string slowest;
+            double slowestTime = 0;
+            for (auto& slot : slots) {
+                std::lock_guard<std::mutex> guard(slot->lock);
+                if (!slot->busy) continue;
+                double t = std::chrono::duration<double>(now - slot->start).count();
+                if (t >= slowestTime) {
+                    slowestTime = t;
+                    slowest = slot->item;
+                }
+            }
+            if (!slowest.empty()) {
+                line << ", slowest: " << slowest << " (" << formatDuration(slowestTime) << ")";
+            }
+        }
+
+        if (tty) {
+            std::cerr << "\r\033[K" << line.str() << (final ? "\n" : "") << std::flush;
+        } else {
+            std::cerr << line.str() << std::endl;
+        }
+    }
+};
+
+// ============================================================================
+// METRICS
+// ============================================================================
+
+// Counters are split into cache-line sized shards picked per thread, so hot
+// paths on many cores never contend on the same line. Readers sum the shards.
+const unsigned METRIC_SHARDS = 16;
+
+unsigned metricShard() {
+    static std::atomic<unsigned> nextShard{0};
+    thread_local unsigned shard = nextShard.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARDS;
+    return shard;
+}
+
+class ShardedCounter {
+public:
+    void add(u64 n) { shards[metricShard()].value.fetch_add(n, std::memory_order_relaxed); }
+
+    u64 total() const {
+        u64 sum = 0;
+        for (const auto& shard : shards) sum += shard.value.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<u64> value{0};
+    };
+    Shard shards[METRIC_SHARDS];
+};
+
+// Upper bounds (seconds) of the latency histogram buckets; +Inf is implicit.
+const double LATENCY_BUCKETS[] = {0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 30};
+const size_t LATENCY_BUCKET_COUNT = sizeof(LATENCY_BUCKETS) / sizeof(LATENCY_BUCKETS[0]);
+
+class ShardedHistogram {
+public:
+    void observe(double seconds) {
+        Shard& shard = shards[metricShard()];
+        size_t b = 0;
+        while (b < LATENCY_BUCKET_COUNT && seconds > LATENCY_BUCKETS[b]) b++;
+        shard.buckets[b].fetch_add(1, std::memory_order_relaxed);
+        shard.sumNs.fetch_add((u64)(seconds * 1e9), std::memory_order_relaxed);
+    }
+
+    // Per-bucket (non-cumulative) counts and the sum of observations.
+    void snapshot(std::vector<u64>& buckets, double& sum) const {
+        buckets.assign(LATENCY_BUCKET_COUNT + 1, 0);
+        u64 sumNs = 0;
+        for (const auto& shard : shards) {
+            for (size_t b = 0; b <= LATENCY_BUCKET_COUNT; b++) buckets[b] += shard.buckets[b].load(std::memory_order_relaxed);
+            sumNs += shard.sumNs.load(std::memory_order_relaxed);
+        }
+        sum = sumNs / 1e9;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<u64> buckets[LATENCY_BUCKET_COUNT + 1] = {};
+        std::atomic<u64> sumNs{0};
+    };
+    Shard shards[METRIC_SHARDS];
+};
+
+enum Stage { STAGE_READ, STAGE_PARSE, STAGE_UNTILE, STAGE_DECODE, STAGE_MIPS, STAGE_WRITE, STAGE_COUNT };
+const char* STAGE_NAMES[STAGE_COUNT] = {"read", "parse", "untile", "decode", "mips", "write"};
+
+enum ErrorKind { ERROR_READ, ERROR_PARSE, ERROR_WRITE, ERROR_WORKER, ERROR_COUNT };
+const char* ERROR_NAMES[ERROR_COUNT] = {"read", "parse", "write", "worker"};
+
+struct Metrics {
+    ShardedCounter bytesRead;
+    ShardedCounter bytesUntiled;
+    ShardedCounter bytesWritten;
+    ShardedCounter filesProcessed;
+    ShardedCounter texturesByFormat[256];
+    ShardedCounter errors[ERROR_COUNT];
+    ShardedHistogram stageLatency[STAGE_COUNT];
+};
+
+Metrics metrics;
+
+// Records the lifetime of a scope into a stage latency histogram.
+class StageTimer {
+public:
+    explicit StageTimer(Stage stage) : stage(stage), start(std::chrono::steady_clock::now()) {}
+    ~StageTimer() {
+        metrics.stageLatency[stage].observe(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    Stage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Renders all metrics in the Prometheus text exposition format.
+std::string renderMetrics() {
+    std::ostringstream out;
+    auto counter = [&](const char* name, const char* help, u64 value) {
+        out << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n"
+            << name << " " << value << "\n";
+    };
+    counter("bntx_bytes_read_total", "Bytes read from input BNTX files.", metrics.bytesRead.total());
+    counter("bntx_bytes_untiled_total", "Bytes of untiled texture data produced.", metrics.bytesUntiled.total());
+    counter("bntx_bytes_written_total", "Bytes written to output files.", metrics.bytesWritten.total());
+    counter("bntx_files_processed_total", "Input files processed, including failed ones.", metrics.filesProcessed.total());
+
+    out << "# HELP bntx_textures_total Textures extracted, by format.\n# TYPE bntx_textures_total counter\n";
+    for (u32 f = 0; f < 256; f++) {
+        u64 n = metrics.texturesByFormat[f].total();
+        if (n == 0) continue;
+        auto fmtIt = formats.find(f);
+        out << "bntx_textures_total{format=\"" << (fmtIt != formats.end() ? fmtIt->second : std::to_string(f))
+            << "\"} " << n << "\n";
+    }
+
+    out << "# HELP bntx_errors_total Failures, by stage.\n# TYPE bntx_errors_total counter\n";
+    for (int e = 0; e < ERROR_COUNT; e++) {
+        out << "bntx_errors_total{stage=\"" << ERROR_NAMES[e] << "\"} " << metrics.errors[e].total() << "\n";
+    }
+
+    out << "# HELP bntx_memory_bytes Bytes currently allocated, by stage.\n# TYPE bntx_memory_bytes gauge\n";
+    for (int st = 0; st < MEM_STAGE_COUNT; st++) {
+        out << "bntx_memory_bytes{stage=\"" << MEMORY_STAGE_NAMES[st] << "\"} " << memoryStats.current[st].load() << "\n";
+    }
+    out << "# HELP bntx_memory_peak_bytes Peak bytes allocated, by stage.\n# TYPE bntx_memory_peak_bytes gauge\n";
+    for (int st = 0; st < MEM_STAGE_COUNT; st++) {
+        out << "bntx_memory_peak_bytes{stage=\"" << MEMORY_STAGE_NAMES[st] << "\"} " << memoryStats.peak[st].load() << "\n";
+    }
+    out << "# HELP bntx_process_peak_rss_bytes Peak resident set size of the extractor.\n"
+        << "# TYPE bntx_process_peak_rss_bytes gauge\n"
+        << "bntx_process_peak_rss_bytes " << peakRSS() << "\n";
+
+    out << "# HELP bntx_stage_duration_seconds Latency of each extraction stage.\n"
+        << "# TYPE bntx_stage_duration_seconds histogram\n";
+    for (int st = 0; st < STAGE_COUNT; st++) {
+        std::vector<u64> buckets;
+        double sum;
+        metrics.stageLatency[st].snapshot(buckets, sum);
+        u64 cumulative = 0;
+        for (size_t b = 0; b <= LATENCY_BUCKET_COUNT; b++) {
+            cumulative += buckets[b];
+            out << "bntx_stage_duration_seconds_bucket{stage=\"" << STAGE_NAMES[st] << "\",le=\"";
+            if (b < LATENCY_BUCKET_COUNT) out << LATENCY_BUCKETS[b];
+            else out << "+Inf";
+            out << "\"} " << cumulative << "\n";
+        }
+        out << "bntx_stage_duration_seconds_sum{stage=\"" << STAGE_NAMES[st] << "\"} " << sum << "\n"
+            << "bntx_stage_duration_seconds_count{stage=\"" << STAGE_NAMES[st] << "\"} " << cumulative << "\n";
+    }
+    return out.str();
+}
+
+// Writes via a temporary file and rename, so the textfile collector never
+// scrapes a half-written file.
+bool writeMetricsFile(const std::string& path) {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out << renderMetrics();
+        if (!out) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    return !ec;
+}
+
+// ============================================================================
+// MANIFEST
+// ============================================================================
+
+// One row per extracted texture, written as TSV so shard manifests can be
+// merged and diffed with standard tools.
+struct ManifestEntry {
+    std::string input;
+    std::string texture;
+    std::string format;
+    u32 width = 0;
+    u32 height = 0;
+    u64 bytes = 0;
+    std::string output;
+    // Decoded textures only; "-" otherwise. Colors are "r,g,b,a".
+    std::string alpha = "-";
+    std::string minColor = "-";
+    std::string maxColor = "-";
+    std::string meanColor = "-";
+    std::string lumaHistogram = "-";    // 16 comma-separated bin counts
+    std::string content = "varied";     // varied, empty or solid:RRGGBBAA
+
+    static const char* header() {
+        return "input\ttexture\tformat\twidth\theight\tbytes\toutput\talpha\tmin\tmax\tmean\tluma_histogram"
+               "\tcontent";
+    }
+
+    static const char* headerV2() {
+        return "input\ttexture\tformat\twidth\theight\tbytes\toutput\talpha\tmin\tmax\tmean\tluma_histogram";
+    }
+
+    static const char* headerV1() {
+        return "input\ttexture\tformat\twidth\theight\tbytes\toutput";
+    }
+
+    void setContent(Content kind, const u8* color) {
+        if (kind == CONTENT_VARIED) content = "varied";
+        else if (kind == CONTENT_EMPTY) content = "empty";
+        else {
+            char hex[16];
+            std::snprintf(hex, sizeof(hex), "%02X%02X%02X%02X", color[0], color[1], color[2], color[3]);
+            content = std::string("solid:") + hex;
+        }
+    }
+
+    void setStats(const TextureStats& stats) {
+        auto join = [](auto values, int n) {
+            std::ostringstream ss;
+            ss << std::fixed << std::setprecision(1);
+            for (int i = 0; i < n; i++) ss << (i ? "," : "") << +values(i);
+            return ss.str();
+        };
+        double pixels = std::max<u64>(stats.pixels, 1);
+        alpha = stats.alphaUsage();
+        minColor = join([&](int c) { return stats.min[c]; }, 4);
+        maxColor = join([&](int c) { return stats.max[c]; }, 4);
+        meanColor = join([&](int c) { return stats.sum[c] / pixels; }, 4);
+        lumaHistogram = join([&](int b) { return stats.histogram[b]; }, 16);
+    }
+
+    std::string toLine() const {
+        auto clean = [](std::string v) {
+            std::replace_if(v.begin(), v.end(), [](char c) { return c == '\t' || c == '\n' || c == '\r'; }, ' ');
+            return v;
+        };
+        std::ostringstream ss;
+        ss << clean(input) << '\t' << clean(texture) << '\t' << format << '\t' << width << '\t'
+           << height << '\t' << bytes << '\t' << clean(output) << '\t' << alpha << '\t' << minColor << '\t'
+           << maxColor << '\t' << meanColor << '\t' << lumaHistogram << '\t' << content;
+        return ss.str();
+    }
+
+    // Accepts v3 rows and the shorter rows of v1 (7 columns) and v2 (12).
+    static bool fromLine(const std::string& line, ManifestEntry& e) {
+        std::vector<std::string> cols;
+        std::istringstream ss(line);
+        for (std::string col; std::getline(ss, col, '\t');) cols.push_back(col);
+        if (cols.size() != 7 && cols.size() != 12 && cols.size() != 13) return false;
+        try {
+            e.input = cols[0];
+            e.texture = cols[1];
+            e.format = cols[2];
+            e.width = (u32)std::stoul(cols[3]);
+            e.height = (u32)std::stoul(cols[4]);
+            e.bytes = std::stoull(cols[5]);
+            e.output = cols[6];
+            if (cols.size() >= 12) {
+                e.alpha = cols[7];
+                e.minColor = cols[8];
+                e.maxColor = cols[9];
+                e.meanColor = cols[10];
+                e.lumaHistogram = cols[11];
+            }
+            if (cols.size() == 13) e.content = cols[12];
+        } catch (const std::exception&) {
+            return false;
+        }
+        return true;
+    }
+
+    // Input and texture first; rows that share both are ordered by their full
+    // line, so identical rows end up adjacent and the order is deterministic.
+    bool operator<(const ManifestEntry& o) const {
+        if (input != o.input) return input < o.input;
+        if (texture != o.texture) return texture < o.texture;
+        return toLine() < o.toLine();
+    }
+};
+
+const char* MANIFEST_MAGIC = "# bntx-extractor manifest v3";
+const char* MANIFEST_MAGIC_V2 = "# bntx-extractor manifest v2";
+const char* MANIFEST_MAGIC_V1 = "# bntx-extractor manifest v1";
+
+struct Manifest {
+    std::mutex lock;
+    std::vector<ManifestEntry> entries;
+
+    void add(std::vector<ManifestEntry>& more) {
+        std::lock_guard<std::mutex> guard(lock);
+        entries.insert(entries.end(), std::make_move_iterator(more.begin()), std::make_move_iterator(more.end()));
+        more.clear();
+    }
+
+    // Rows are sorted so the same corpus always yields a byte-identical manifest.
+    bool write(const std::string& path) {
+        std::sort(entries.begin(), entries.end());
+        std::ofstream out(path, std::ios::binary);
+        out << MANIFEST_MAGIC << "\n" << ManifestEntry::header() << "\n";
+        for (const auto& e : entries) out << e.toLine() << "\n";
+        return (bool)out;
+    }
+
+    bool read(const std::string& path, std::string& error) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            error = "cannot open";
+            return false;
+        }
+        std::string line;
+        if (!std::getline(in, line) ||
+            (line != MANIFEST_MAGIC && line != MANIFEST_MAGIC_V2 && line != MANIFEST_MAGIC_V1)) {
+            error = "not a manifest (or unsupported version)";
+            return false;
+        }
+        const char* columns = line == MANIFEST_MAGIC    ? ManifestEntry::header()
+                              : line == MANIFEST_MAGIC_V2 ? ManifestEntry::headerV2()
+                                                          : ManifestEntry::headerV1();
+        if (!std::getline(in, line) || line != columns) {
+            error = "unexpected columns";
+            return false;
+        }
+        for (size_t lineNo = 3; std::getline(in, line); lineNo++) {
+            if (line.empty()) continue;
+            ManifestEntry e;
+            if (!ManifestEntry::fromLine(line, e)) {
+                error = "malformed row at line " + std::to_string(lineNo);
+                return false;
+            }
+            entries.push_back(std::move(e));
+        }
+        return true;
+    }
+};
+
+// ============================================================================
+// FILE I/O
+// ============================================================================
+
+// How whole input files are read and output files written, set once from the
+// command line like verbose. The stream defaults work everywhere; the others
+// are POSIX (io_uring Linux-only) and fall back to the defaults elsewhere.
+// bench io times all of them so each host can pick its fastest.
+enum ReadStrategy { READ_IFSTREAM, READ_PREAD, READ_MMAP, READ_DIRECT, READ_STRATEGY_COUNT };
+const char* READ_STRATEGY_NAMES[READ_STRATEGY_COUNT] = {"ifstream", "pread", "mmap", "direct"};
+enum WriteStrategy { WRITE_OFSTREAM, WRITE_WRITEV, WRITE_MMAP, WRITE_URING, WRITE_STRATEGY_COUNT };
+const char* WRITE_STRATEGY_NAMES[WRITE_STRATEGY_COUNT] = {"ofstream", "writev", "mmap", "io_uring"};
+
+struct IoOptions {
+    ReadStrategy read = READ_IFSTREAM;
+    WriteStrategy write = WRITE_OFSTREAM;
+};
+IoOptions ioOptions;
+
+// Chunk size of pread and O_DIRECT reads; a multiple of any block size.
+const size_t READ_CHUNK_SIZE = 4 * 1024 * 1024;
+const size_t DIRECT_IO_ALIGNMENT = 4096;
+
+bool readFileStream(const std::string& path, FileBuffer& data) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return false;
+
+    std::streamsize fileSize = file.tellg();
+    if (fileSize < 0) return false;
+    file.seekg(0, std::ios::beg);
+
+    data.resize(fileSize);
+    return (bool)file.read(reinterpret_cast<char*>(data.data()), fileSize);
+}
+
+// A whole file mapped read-only, so structures can be read in place and only
+// the pages actually touched come from storage. Where mmap is unavailable the
+// file is read into memory instead.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        if (!readFileStream(path, buffer)) return false;
+        base = buffer.data();
+        fileSize = buffer.size();
+        return true;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0;
+        fileSize = ok ? (u64)st.st_size : 0;
+        if (ok && fileSize > 0) {
+            void* p = mmap(nullptr, (size_t)fileSize, PROT_READ, MAP_SHARED, fd, 0);
+            ok = p != MAP_FAILED;
+            if (ok) base = static_cast<const u8*>(p);
+        }
+        ::close(fd);
+        return ok;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        buffer = FileBuffer();
+#else
+        if (base) munmap(const_cast<u8*>(base), (size_t)fileSize);
+#endif
+        base = nullptr;
+        fileSize = 0;
+    }
+
+    const u8* data() const { return base; }
+    u64 size() const { return fileSize; }
+
+private:
+#ifdef _WIN32
+    FileBuffer buffer;
+#endif
+    const u8* base = nullptr;
+    u64 fileSize = 0;
+};
+
+#ifndef _WIN32
+// Reads [0, data.size()) of fd in READ_CHUNK_SIZE preads. With a bounce buffer
+// (O_DIRECT needs aligned memory) each chunk lands there first.
+bool preadChunks(int fd, FileBuffer& data, u8* bounce) {
+    for (u64 offset = 0; offset < data.size();) {
+        size_t want = std::min<u64>(READ_CHUNK_SIZE, data.size() - offset);
+        u8* dst = bounce ? bounce : data.data() + offset;
+        // O_DIRECT lengths must be whole blocks; the tail read simply comes back short
+        ssize_t n = pread(fd, dst, bounce ? READ_CHUNK_SIZE : want, (off_t)offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        size_t got = std::min<size_t>((size_t)n, want);
+        if (bounce) std::memcpy(data.data() + offset, bounce, got);
+        offset += got;
+    }
+    return true;
+}
+
+bool readFilePread(const std::string& path, FileBuffer& data, bool direct) {
+    int fd = -1;
+#ifdef O_DIRECT
+    if (direct) {
+        fd = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+        // Filesystems without O_DIRECT (tmpfs) refuse it; read them buffered
+        if (fd < 0 && errno == EINVAL) direct = false;
+    }
+#else
+    direct = false;
+#endif
+    if (fd < 0) fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    if (ok) {
+        data.resize((size_t)st.st_size);
+        void* bounce = nullptr;
+        if (direct && posix_memalign(&bounce, DIRECT_IO_ALIGNMENT, READ_CHUNK_SIZE) != 0) bounce = nullptr;
+        ok = (!direct || bounce) && preadChunks(fd, data, static_cast<u8*>(bounce));
+        free(bounce);
+    }
+    ::close(fd);
+    return ok;
+}
+#endif
+
+bool readFile(const std::string& path, FileBuffer& data) {
+#ifndef _WIN32
+    switch (ioOptions.read) {
+    case READ_PREAD:
+        return readFilePread(path, data, false);
+    case READ_DIRECT:
+        return readFilePread(path, data, true);
+    case READ_MMAP: {
+        MappedFile file;
+        if (!file.open(path)) return false;
+        data.assign(file.data(), file.data() + file.size());
+        return true;
+    }
+    default:
+        break;
+    }
+#endif
+    return readFileStream(path, data);
+}
+
+#ifndef _WIN32
+// Drops the first n bytes from an iovec array after a short transfer.
+void advanceIovecs(iovec*& iov, int& count, size_t n) {
+    while (n > 0 && count > 0) {
+        size_t take = std::min(n, iov->iov_len);
+        iov->iov_base = static_cast<u8*>(iov->iov_base) + take;
+        iov->iov_len -= take;
+        n -= take;
+        if (iov->iov_len == 0) {
+            iov++;
+            count--;
+        }
+    }
+    while (count > 0 && iov->iov_len == 0) {
+        iov++;
+        count--;
+    }
+}
+
+bool writevAll(int fd, iovec* iov, int count) {
+    advanceIovecs(iov, count, 0);
+    while (count > 0) {
+        ssize_t n = ::writev(fd, iov, count);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        advanceIovecs(iov, count, (size_t)n);
+    }
+    return true;
+}
+
+bool writeMapped(int fd, iovec* iov, int count) {
+    size_t total = 0;
+    for (int i = 0; i < count; i++) total += iov[i].iov_len;
+    if (total == 0) return true;
+    if (ftruncate(fd, (off_t)total) != 0) return false;
+    void* p = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) return false;
+    u8* dst = static_cast<u8*>(p);
+    for (int i = 0; i < count; i++) {
+        std::memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+        dst += iov[i].iov_len;
+    }
+    return munmap(p, total) == 0;
+}
+#endif
+
+#ifdef HAVE_IO_URING
+// A minimal io_uring on raw syscalls, one per writing thread. Each file is one
+// IORING_OP_WRITEV submission waited for before returning, so callers keep
+// ownership of their buffers; what it saves is the copy-in of the iovecs and
+// the per-call syscall entry of writev on large files split into chunks.
+class IoRing {
+public:
+    IoRing() = default;
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    ~IoRing() {
+        if (sqRing) munmap(sqRing, sqRingSize);
+        if (cqRing) munmap(cqRing, cqRingSize);
+        if (sqes) munmap(sqes, sqesSize);
+        if (ringFd >= 0) ::close(ringFd);
+    }
+
+    bool init() {
+        io_uring_params params = {};
+        ringFd = (int)syscall(__NR_io_uring_setup, 4, &params);
+        if (ringFd < 0) return false;
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(u32);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqRing = mapRing(sqRingSize, IORING_OFF_SQ_RING);
+        cqRing = mapRing(cqRingSize, IORING_OFF_CQ_RING);
+        sqes = static_cast<io_uring_sqe*>(mapRing(sqesSize, IORING_OFF_SQES));
+        if (!sqRing || !cqRing || !sqes) return false;
+
+        u8* sq = static_cast<u8*>(sqRing);
+        u8* cq = static_cast<u8*>(cqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // Writes the iovecs to fd from offset 0, resubmitting after short writes.
+    bool writev(int fd, iovec* iov, int count) {
+        u64 offset = 0;
+        advanceIovecs(iov, count, 0);
+        while (count > 0) {
+            unsigned tail = *sqTail;
+            unsigned index = tail & sqMask;
+            io_uring_sqe& sqe = sqes[index];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_WRITEV;
+            sqe.fd = fd;
+            sqe.addr = (u64)(uintptr_t)iov;
+            sqe.len = (u32)count;
+            sqe.off = offset;
+            sqArray[index] = index;
+            __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+            int rc;
+            do {
+                rc = (int)syscall(__NR_io_uring_enter, ringFd, 1, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            } while (rc < 0 && errno == EINTR);
+            if (rc < 0) return false;
+
+            unsigned head = *cqHead;
+            if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) return false;
+            int res = cqes[head & cqMask].res;
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+            if (res <= 0) return false;
+            offset += (u64)res;
+            advanceIovecs(iov, count, (size_t)res);
+        }
+        return true;
+    }
+
+private:
+    int ringFd = -1;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqRingSize = 0, cqRingSize = 0, sqesSize = 0;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    void* mapRing(size_t size, off_t offset) {
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, offset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+};
+
+// The calling thread's ring, or nullptr where io_uring is unavailable (old
+// kernels, seccomp-restricted containers).
+IoRing* threadRing() {
+    thread_local std::unique_ptr<IoRing> ring;
+    thread_local bool tried = false;
+    if (!tried) {
+        tried = true;
+        ring = std::make_unique<IoRing>();
+        if (!ring->init()) ring.reset();
+    }
+    return ring.get();
+}
+#endif
+
+// Whether both strategies run as themselves here. Elsewhere reads fall back to
+// ifstream and writes to ofstream, or io_uring writes to writev.
+bool ioStrategySupported(ReadStrategy read, WriteStrategy write) {
+#ifdef _WIN32
+    return read == READ_IFSTREAM && write == WRITE_OFSTREAM;
+#elif defined(HAVE_IO_URING)
+    (void)read;
+    return write != WRITE_URING || threadRing() != nullptr;
+#else
+    (void)read;
+    return write != WRITE_URING;
+#endif
+}
+
+// Creates path holding header followed by payload.
+bool writeOutputFile(const std::string& path, const u8* header, size_t headerSize,
+                     const u8* payload, size_t payloadSize) {
+#ifndef _WIN32
+    if (ioOptions.write != WRITE_OFSTREAM) {
+        iovec iov[2] = {{const_cast<u8*>(header), headerSize}, {const_cast<u8*>(payload), payloadSize}};
+        int flags = ioOptions.write == WRITE_MMAP ? O_RDWR : O_WRONLY;
+        int fd = ::open(path.c_str(), flags | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        bool ok;
+        if (ioOptions.write == WRITE_MMAP) {
+            ok = writeMapped(fd, iov, 2);
+#ifdef HAVE_IO_URING
+        } else if (ioOptions.write == WRITE_URING && threadRing()) {
+            ok = threadRing()->writev(fd, iov, 2);
+#endif
+        } else {
+            ok = writevAll(fd, iov, 2);
+        }
+        return ::close(fd) == 0 && ok;
+    }
+#endif
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+    out.write(reinterpret_cast<const char*>(header), headerSize);
+    out.write(reinterpret_cast<const char*>(payload), payloadSize);
+    out.close();
+    return (bool)out;
+}
+
+// For --read and --write.
+bool selectReadStrategy(const std::string& name) {
+    for (int s = 0; s < READ_STRATEGY_COUNT; s++) {
+        if (name == READ_STRATEGY_NAMES[s]) {
+            ioOptions.read = (ReadStrategy)s;
+            return true;
+        }
+    }
+    std::cerr << "Error: unknown read strategy " << name << std::endl;
+    return false;
+}
+
+bool selectWriteStrategy(const std::string& name) {
+    for (int s = 0; s < WRITE_STRATEGY_COUNT; s++) {
+        if (name == WRITE_STRATEGY_NAMES[s]) {
+            ioOptions.write = (WriteStrategy)s;
+            return true;
+        }
+    }
+    std::cerr << "Error: unknown write strategy " << name << std::endl;
+    return false;
+}
+
+// ============================================================================
+// TEXTURE EXPORT
+// ============================================================================
+
+// A texture ready to be written: untiled payload plus its DDS header.
+struct EncodedTexture {
+    std::string name;
+    std::string formatName;
+    u32 format = 0;
+    u32 width = 0;
+    u32 height = 0;
+    u32 blkWidth = 1;
+    u32 blkHeight = 1;
+    u32 bpp = 4;
+    HeaderBuffer header;
+    SurfaceBuffer payload;
+    std::vector<u32> mipSizes;      // per level, when --gen-mips added a chain
+    SurfaceBuffer packed;           // LZ4 chunk tables and chunks, for compressed packs
+    std::vector<u32> packedSizes;   // per level, within packed
+    bool hasStats = false;
+    TextureStats stats;
+    Content content = CONTENT_VARIED;
+    u8 solidColor[4] = {};
+    
+    // Size of each level in payload; one level unless mips were generated.
+    std::vector<u32> levels() const {
+        return mipSizes.empty() ? std::vector<u32>(1, (u32)payload.size()) : mipSizes;
+    }
+};
+
+// True if --skip-solid drops this texture instead of writing it.
+inline bool skipTexture(const EncodedTexture& enc) {
+    return skipSolidTextures && enc.content != CONTENT_VARIED;
+}
+
+// Untiles one texture; false if its format is not supported.
+bool encodeTexture(const BNTXTexture& tex, EncodedTexture& enc) {
+    u32 formatType = tex.format >> 8;
+    
+    u32 blkWidth, blkHeight, bpp;
+    if (!formatInfo(formatType, blkWidth, blkHeight, bpp)) {
+        std::cout << "\nSkipping " << tex.name << " - unsupported format (0x" 
+                  << std::hex << tex.format << std::dec << ")" << std::endl;
+        return false;
+    }
+    auto fmtIt = formats.find(formatType);
+    
+    u32 size = DIV_ROUND_UP(tex.width, blkWidth) * DIV_ROUND_UP(tex.height, blkHeight) * bpp;
+    
+    if (verbose) std::cout << "\nProcessing: " << tex.name << " (" << fmtIt->second << ")" << std::endl;
+    
+    {
+        StageTimer timer(STAGE_UNTILE);
+        enc.payload = deswizzle(
+            tex.width, tex.height, 
+            blkWidth, blkHeight, 
+            bpp, tex.tileMode, 
+            tex.alignment, tex.sizeRange, 
+            tex.data
+        );
+    }
+    
+    if (enc.payload.size() > size) {
+        enc.payload.resize(size);
+    }
+    enc.content = classifySurface(tex.format, tex.compSel, tex.width, tex.height, enc.payload, enc.solidColor);
+    metrics.bytesUntiled.add(enc.payload.size());
+    metrics.texturesByFormat[formatType].add(1);
+    
+    enc.header = generateDDSHeader(tex.width, tex.height, formatType, size);
+    bool srgb = isSRGB(tex.format) && srgbDXGIFormat(formatType);
+    if (srgb) useDX10Header(enc.header, srgbDXGIFormat(formatType));
+    enc.name = tex.name;
+    enc.formatName = srgb ? fmtIt->second + "_SRGB" : fmtIt->second;
+    enc.format = tex.format;
+    enc.width = tex.width;
+    enc.height = tex.height;
+    enc.blkWidth = blkWidth;
+    enc.blkHeight = blkHeight;
+    enc.bpp = bpp;
+    
+    if (skipTexture(enc)) {
+        if (verbose) std::cout << "Skipping " << tex.name << " - solid or empty" << std::endl;
+        return true;
+    }
+    
+    NormalMode normal = formatType == 0x1e ? decodeOptions.normalMap : NORMAL_OFF;
+    if (decodeOptions.enabled || decodeOptions.scale > 1 || normal) {
+        SurfaceDecode params;
+        params.normal = normal;
+        params.scale = decodeOptions.scale;
+        params.stats = &enc.stats;
+        if (!normal) params.colorTable = colorTableFor(tex.format, decodeOptions.colorSpace);
+        bool outputSRGB = !normal && isColorFormat(formatType) &&
+                          (decodeOptions.colorSpace == COLOR_KEEP ? isSRGB(tex.format)
+                                                                  : decodeOptions.colorSpace == COLOR_SRGB);
+        SurfaceBuffer rgba;
+        bool decoded;
+        {
+            StageTimer timer(STAGE_DECODE);
+            decoded = decodeSurface(tex.format, tex.compSel, tex.width, tex.height, enc.payload, rgba, params);
+        }
+        if (decoded) {
+            bool alpha = normal != NORMAL_RGB;
+            enc.hasStats = true;
+            enc.width = DIV_ROUND_UP(tex.width, params.scale);
+            enc.height = DIV_ROUND_UP(tex.height, params.scale);
+            enc.payload = std::move(rgba);
+            enc.header = generateRGB8DDSHeader(enc.width, enc.height, alpha);
+            if (outputSRGB) useDX10Header(enc.header, srgbDXGIFormat(0x0b));
+            enc.format = alpha ? (outputSRGB ? 0x0b06 : 0x0b01) : 0;
+            enc.blkWidth = enc.blkHeight = 1;
+            enc.bpp = alpha ? 4 : 3;
+            if (generateMipChain) {
+                StageTimer timer(STAGE_MIPS);
+                enc.mipSizes = generateMips(enc.payload, enc.width, enc.height, enc.bpp, outputSRGB);
+                setDDSMipCount(enc.header, (u32)enc.mipSizes.size());
+            }
+        } else if (verbose) {
+            std::cout << "Cannot decode " << fmtIt->second << ", keeping it compressed" << std::endl;
+        }
+    }
+    return true;
+}
+
+bool writeTexture(const EncodedTexture& enc, const std::string& outputDir,
+                  std::vector<ManifestEntry>* manifest) {
+    if (skipTexture(enc)) {
+        progress.texturesDone.fetch_add(1, std::memory_order_relaxed);
+        if (manifest) {
+            ManifestEntry entry;
+            entry.texture = enc.name;
+            entry.format = enc.formatName;
+            entry.width = enc.width;
+            entry.height = enc.height;
+            entry.output = "-";
+            entry.setContent(enc.content, enc.solidColor);
+            manifest->push_back(std::move(entry));
+        }
+        return true;
+    }
+    
+    StageTimer timer(STAGE_WRITE);
+    std::string outName = outputDir + "/" + enc.name + ".dds";
+    if (!writeOutputFile(outName, enc.header.data(), enc.header.size(), enc.payload.data(), enc.payload.size())) {
+        std::cerr << "Failed to write " << outName << std::endl;
+        metrics.errors[ERROR_WRITE].add(1);
+        return false;
+    }
+    
+    u64 bytes = enc.header.size() + enc.payload.size();
+    metrics.bytesWritten.add(bytes);
+    progress.texturesDone.fetch_add(1, std::memory_order_relaxed);
+    progress.bytesOut.fetch_add(bytes, std::memory_order_relaxed);
+    
+    if (manifest) {
+        ManifestEntry entry;
+        entry.texture = enc.name;
+        entry.format = enc.formatName;
+        entry.width = enc.width;
+        entry.height = enc.height;
+        entry.bytes = bytes;
+        entry.output = outName;
+        if (enc.hasStats) entry.setStats(enc.stats);
+        entry.setContent(enc.content, enc.solidColor);
+        manifest->push_back(std::move(entry));
+    }
+    
+    if (verbose) std::cout << "Saved: " << outName << std::endl;
+    return true;
+}
+
+// ============================================================================
+// TEXTURE PACK EXPORT
+// ============================================================================
+
+const u32 PACK_CHUNK_SIZE = 64 * 1024;
+
+// Writes the pack described in texpack.h: payloads are appended page-aligned as
+// textures arrive, names and the hash-sorted index go at the end, and the
+// header is filled in last.
+class TexPackWriter {
+public:
+    bool open(const std::string& path, bool lz4 = false) {
+        compress = lz4;
+        out.open(path, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        offset = texpack::PAYLOAD_ALIGNMENT;
+        std::vector<char> zeros(offset, 0);
+        out.write(zeros.data(), zeros.size());
+        return (bool)out;
+    }
+
+    // Compresses enc.payload into enc.packed when the pack is compressed. Called
+    // by the untile workers so chunks are compressed in parallel with the
+    // writer; each chunk is independent so readers can decode them in any order.
+    void encode(EncodedTexture& enc) const {
+        if (!compress) return;
+        std::vector<u32> levels = enc.levels();
+        size_t bound = 0;
+        for (u32 size : levels) bound += packedBound(size);
+        enc.packed.resize(bound);
+        enc.packedSizes.clear();
+
+        size_t in = 0, out = 0;
+        for (u32 size : levels) {
+            size_t chunks = (size + PACK_CHUNK_SIZE - 1) / PACK_CHUNK_SIZE;
+            size_t tableBytes = chunks * sizeof(u32);
+            u8* table = enc.packed.data() + out;
+
+            size_t stored = 0;
+            for (size_t c = 0; c < chunks; c++) {
+                const u8* src = enc.payload.data() + in + c * PACK_CHUNK_SIZE;
+                size_t raw = std::min<size_t>(PACK_CHUNK_SIZE, size - c * PACK_CHUNK_SIZE);
+                u8* dst = table + tableBytes + stored;
+                size_t packedSize = texpack::lz4Compress(src, raw, dst);
+                if (packedSize >= raw) {
+                    std::memcpy(dst, src, raw);
+                    packedSize = raw;
+                }
+                stored += packedSize;
+                u32 end = (u32)stored;
+                std::memcpy(table + c * sizeof(u32), &end, sizeof(u32));
+            }
+            enc.packedSizes.push_back((u32)(tableBytes + stored));
+            in += size;
+            out += tableBytes + stored;
+        }
+        enc.packed.resize(out);
+    }
+
+    bool compressed() const { return compress; }
+
+    // Bytes encode() may need for a level of the given size: its chunk table
+    // and the worst-case LZ4 output.
+    static size_t packedBound(size_t size) {
+        return (size + PACK_CHUNK_SIZE - 1) / PACK_CHUNK_SIZE * sizeof(u32) + texpack::lz4Bound(size);
+    }
+
+    bool add(const std::string& name, const EncodedTexture& enc) {
+        if (!names.insert(name).second) {
+            std::cerr << "Warning: duplicate texture " << name << " not added to pack" << std::endl;
+            return false;
+        }
+
+        texpack::TexPackEntry e = {};
+        e.nameHash = texpack::hashName(name.data(), name.size());
+        e.nameOffset = (u32)nameBlob.size();
+        e.nameLength = (u32)name.size();
+        e.format = enc.format;
+        e.width = enc.width;
+        e.height = enc.height;
+        e.blockWidth = enc.blkWidth;
+        e.blockHeight = enc.blkHeight;
+        e.bytesPerBlock = enc.bpp;
+        e.flags = compress ? texpack::FLAG_LZ4 : 0;
+
+        // The top level starts on a page; smaller levels follow it packed.
+        std::vector<u32> levels = enc.levels();
+        const SurfaceBuffer& stored = compress ? enc.packed : enc.payload;
+        const std::vector<u32>& storedSizes = compress ? enc.packedSizes : levels;
+        e.mipCount = (u32)levels.size();
+        size_t pos = 0;
+        for (u32 m = 0; m < e.mipCount; m++) {
+            if (m > 0) pad(texpack::MIP_ALIGNMENT);
+            e.mipOffset[m] = offset;
+            e.mipSize[m] = levels[m];
+            out.write(reinterpret_cast<const char*>(stored.data() + pos), storedSizes[m]);
+            offset += storedSizes[m];
+            pos += storedSizes[m];
+        }
+        entries.push_back(e);
+        nameBlob.insert(nameBlob.end(), name.begin(), name.end());
+        nameBlob.push_back(0);
+        pad(texpack::PAYLOAD_ALIGNMENT);
+
+        metrics.bytesWritten.add(stored.size());
+        progress.bytesOut.fetch_add(stored.size(), std::memory_order_relaxed);
+        return (bool)out;
+    }
+
+    bool finish() {
+        texpack::TexPackHeader h = {};
+        std::memcpy(h.magic, texpack::MAGIC, sizeof(h.magic));
+        h.version = texpack::VERSION;
+        h.textureCount = (u32)entries.size();
+        h.payloadAlignment = texpack::PAYLOAD_ALIGNMENT;
+        h.chunkSize = compress ? PACK_CHUNK_SIZE : 0;
+
+        h.namesOffset = offset;
+        h.namesSize = nameBlob.size();
+        out.write(nameBlob.data(), nameBlob.size());
+        offset += nameBlob.size();
+        pad(alignof(texpack::TexPackEntry));
+
+        std::sort(entries.begin(), entries.end(), [this](const texpack::TexPackEntry& a, const texpack::TexPackEntry& b) {
+            if (a.nameHash != b.nameHash) return a.nameHash < b.nameHash;
+            return std::strcmp(&nameBlob[a.nameOffset], &nameBlob[b.nameOffset]) < 0;
+        });
+        h.indexOffset = offset;
+        out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(texpack::TexPackEntry));
+        offset += entries.size() * sizeof(texpack::TexPackEntry);
+        h.fileSize = offset;
+
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.close();
+        return !out.fail();
+    }
+
+private:
+    std::ofstream out;
+    bool compress = false;
+    u64 offset = 0;
+    std::vector<texpack::TexPackEntry> entries;
+    std::vector<char> nameBlob;
+    std::set<std::string> names;
+
+    void pad(u64 alignment) {
+        u64 aligned = (offset + alignment - 1) / alignment * alignment;
+        static const char zeros[texpack::PAYLOAD_ALIGNMENT] = {};
+        out.write(zeros, aligned - offset);
+        offset = aligned;
+    }
+};
+
+// Bytes a texture holds at its peak while being extracted: the tiled input
+// span, the untiled surface deswizzle() allocates, the DDS header, the RGBA
+// output when encodeTexture() decodes it plus a third more for a generated
+// mip chain, and the LZ4 buffer when it goes into a compressed pack.
+u64 estimateWorkingSet(const BNTXTexture& tex, const TexPackWriter* pack = nullptr) {
+    u32 formatType = tex.format >> 8;
+    u32 blkWidth, blkHeight, bpp;
+    if (!formatInfo(formatType, blkWidth, blkHeight, bpp)) return tex.imageSize;
+    
+    u32 pitch, surfSize;
+    surfaceLayout(DIV_ROUND_UP(tex.width, blkWidth), DIV_ROUND_UP(tex.height, blkHeight),
+                  bpp, tex.tileMode, tex.alignment, tex.sizeRange, pitch, surfSize);
+    u64 bytes = (u64)tex.imageSize + surfSize + 128;
+    u64 output = surfSize;
+
+    NormalMode normal = formatType == 0x1e ? decodeOptions.normalMap : NORMAL_OFF;
+    if ((decodeOptions.enabled || decodeOptions.scale > 1 || normal) && canDecode(formatType)) {
+        u64 pixels = (u64)DIV_ROUND_UP(tex.width, decodeOptions.scale) * DIV_ROUND_UP(tex.height, decodeOptions.scale);
+        output = pixels * (normal == NORMAL_RGB ? 3 : 4);
+        if (generateMipChain) output += output / 3;
+        bytes += output;
+    }
+    if (pack && pack->compressed()) bytes += TexPackWriter::packedBound(output);
+    return bytes;
+}
+
+void saveTextures(const std::vector<BNTXTexture>& textures, const std::string& outputDir,
+                  std::vector<ManifestEntry>* manifest = nullptr) {
+    for (const auto& tex : textures) {
+        EncodedTexture enc;
+        if (encodeTexture(tex, enc)) {
+            writeTexture(enc, outputDir, manifest);
+        }
+    }
+}
+
+// ============================================================================
+// BATCH MODE
+// ============================================================================
+
+struct BatchJob {
+    std::string inputPath;
+    std::string outputDir;
+    std::string packPrefix;
+    u64 size = 0;
+    u64 work = 0;
+};
+
+struct BatchOptions {
+    std::vector<std::string> inputs;
+    std::string outputDir;
+    unsigned jobs = 0;
+    bool showProgress = true;
+    u32 progressIntervalMs = 500;
+    bool isolate = false;
+    u32 timeoutSec = 0;
+    std::string failedLog;
+    std::string manifestPath;
+    std::string metricsPath;
+    u32 metricsIntervalSec = 15;
+    std::string memoryReportPath;
+    u64 memoryBudget = 0;
+    bool planIO = true;
+    bool pin = false;
+    std::string packPath;
+    bool packLZ4 = false;
+    u32 shardIndex = 0;
+    u32 shardCount = 1;
+};
+
+// Per-file memory rows for --memory-report. The process-wide columns are taken
+// when the file finishes, so they include whatever ran concurrently.
+struct MemoryReport {
+    std::mutex lock;
+    std::vector<std::string> rows;
+
+    void add(const std::string& input, const FileMemory& m, u64 trackedPeak, u64 rss) {
+        std::ostringstream row;
+        row << input << '\t' << m.fileBuffer << '\t' << m.textureData << '\t' << m.untiled << '\t' << m.headers
+            << '\t' << trackedPeak << '\t' << rss;
+        std::lock_guard<std::mutex> guard(lock);
+        rows.push_back(row.str());
+    }
+
+    bool write(const std::string& path) {
+        std::sort(rows.begin(), rows.end());
+        std::ofstream out(path, std::ios::binary);
+        out << "input\tfile_buffer\ttexture_data\tuntiled\theaders\ttracked_peak\tpeak_rss\n";
+        for (const auto& row : rows) out << row << "\n";
+        return (bool)out;
+    }
+};
+
+void printMemorySummary(u64 rss = peakRSS()) {
+    std::cerr << "Memory peak:";
+    for (int st = 0; st < MEM_STAGE_COUNT; st++) {
+        std::cerr << " " << MEMORY_STAGE_NAMES[st] << " " << formatMB(memoryStats.peak[st].load());
+    }
+    std::cerr << ", tracked total " << formatMB(memoryStats.totalPeak.load());
+    if (rss) std::cerr << ", peak RSS " << formatMB(rss);
+    std::cerr << std::endl;
+}
+
+// Files that could not be extracted, with the reason, collected from every worker.
+struct FailureLog {
+    std::mutex lock;
+    std::vector<std::pair<std::string, std::string>> entries;
+
+    void add(const std::string& path, const std::string& reason) {
+        std::lock_guard<std::mutex> guard(lock);
+        entries.emplace_back(path, reason);
+        progress.filesFailed.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Parses the decimal value of a numeric option into an unsigned T; prints an
+// error and returns false on anything else, including values T cannot hold.
+template <typename T>
+bool parseOption(const std::string& option, const std::string& text, T& value) {
+    u64 parsed = 0;
+    bool ok = !text.empty() && text.find_first_not_of("0123456789") == std::string::npos;
+    if (ok) {
+        try {
+            parsed = std::stoull(text);
+        } catch (const std::exception&) {
+            ok = false;
+        }
+    }
+    if (!ok || parsed > (u64)(T)-1) {
+        std::cerr << "Error: " << option << " expects a number, got \"" << text << "\"" << std::endl;
+        return false;
+    }
+    value = (T)parsed;
+    return true;
+}
+
+void printUsage(const char* exe) {
+    std::cout << "Usage: " << exe << " [options] <file.bntx | directory>... -o <output dir>\n"
+              << "       " << exe << "            (no arguments: interactive mode)\n\n"
+              << "Options:\n"
+              << "  -o, --output <dir>        Output directory\n"
+              << "  -j, --jobs <n>            Worker threads (default: all cores)\n"
+              << "  --no-progress             Disable the progress line\n"
+              << "  --progress-interval <ms>  Progress update rate (default: 500)\n"
+              << "  --isolate                 Extract in forked worker processes; a crashing\n"
+              << "                            file is recorded and its worker restarted\n"
+              << "  --timeout <sec>           With --isolate: kill files taking longer than this\n"
+              << "  --failed-log <file>       Write failed files and reasons to <file>\n"
+              << "  --manifest <file>         Write a TSV manifest of every extracted texture\n"
+              << "  --metrics <file.prom>     Periodically write Prometheus metrics (textfile format)\n"
+              << "  --metrics-interval <sec>  Metrics write interval (default: 15)\n"
+              << "  --memory-report <file>    Write per-file memory use per stage (TSV)\n"
+              << "  --memory-budget <MB>      Admit textures only while their estimated working\n"
+              << "                            sets fit in this budget (default: unlimited)\n"
+              << "  --pack <file.texpack>     Also write all textures, untiled, into one mmap-able\n"
+              << "                            pack (see texpack.h); -o is optional with --pack\n"
+              << "  --pack-lz4                Store pack payloads as independently LZ4-compressed\n"
+              << "                            64 KiB chunks\n"
+              << "  --decode                  Write RGBA8 DDS with the BRTI channel selectors\n"
+              << "                            applied (BC6H, BC7 and ASTC stay compressed)\n"
+              << "  --normal-map <rgb|rgba>   Decode BC5 textures as normal maps, rebuilding Z\n"
+              << "  --skip-solid              Do not write solid-color or empty textures (they\n"
+              << "                            are still listed in the manifest)\n"
+              << "  --downscale <n>           Decode at 1/n size (2, 4, 8 or 16) for previews;\n"
+              << "                            BCn previews average blocks without full decode\n"
+              << "  --gen-mips                Give decoded output a full mip chain (box filter,\n"
+              << "                            averaged in linear light for sRGB)\n"
+              << "  --color-space <srgb|linear>\n"
+              << "                            With --decode: convert color textures to this\n"
+              << "                            space (default: keep each texture's own)\n"
+              << "  --no-io-plan              Read each file whole instead of scanning headers\n"
+              << "                            first and reading texture spans in disk order\n"
+              << "  --pin                     Pin untile workers to CPUs and keep each texture's\n"
+              << "                            buffers and worker on one NUMA node\n"
+              << "  --isa <set>               SIMD kernels: auto (default), scalar, sse2, ssse3,\n"
+              << "                            avx2 or neon\n"
+              << "  --read <how>              Whole-file reads (--no-io-plan, --isolate): ifstream\n"
+              << "                            (default), pread, mmap or direct (O_DIRECT)\n"
+              << "  --write <how>             Output file writes: ofstream (default), writev,\n"
+              << "                            mmap or io_uring\n"
+              << "  --shard <i>/<n>           Only process shard i (0-based) of n; shards are\n"
+              << "                            balanced by file size and texture count\n"
+              << "  -v, --verbose             Log every texture like interactive mode\n"
+              << "  -h, --help                Show this help\n"
+              << "\nDirectories are searched recursively for .bntx files; each file is\n"
+              << "extracted into its own subdirectory of the output directory.\n"
+              << "\nCommands:\n"
+              << "  " << exe << " merge -o <merged.tsv> <manifest.tsv>...\n"
+              << "                            Combine per-shard manifests into one\n"
+              << "  " << exe << " sheet [--thumb <px>] [--columns <n>] <file.bntx | directory>... -o <dir>\n"
+              << "                            Write one PNG contact sheet per file\n"
+              << "  " << exe << " validate [--problems-only] <file.bntx | directory>...\n"
+              << "                            Check files for corruption and unsupported\n"
+              << "                            formats without extracting them\n"
+              << "  " << exe << " bench <kind> ...\n"
+              << "                            Run a benchmark (see bench --help)\n";
+}
+
+bool hasBntxExtension(const std::filesystem::path& p) {
+    std::string ext = p.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    return ext == ".bntx";
+}
+
+// Expands directories and assigns every input its output directory. Sorted so
+// runs over the same tree always process files in the same order.
+std::vector<BatchJob> collectJobs(const BatchOptions& opts) {
+    namespace fs = std::filesystem;
+    std::vector<BatchJob> jobs;
+    bool singleFile = opts.inputs.size() == 1 && !fs::is_directory(opts.inputs[0]);
+
+    for (const auto& input : opts.inputs) {
+        std::error_code ec;
+        if (fs::is_directory(input, ec)) {
+            std::vector<BatchJob> found;
+            for (fs::recursive_directory_iterator it(input, ec), end; it != end; it.increment(ec)) {
+                if (ec) break;
+                if (!it->is_regular_file(ec) || !hasBntxExtension(it->path())) continue;
+                fs::path rel = fs::relative(it->path(), input, ec);
+                rel.replace_extension();
+                BatchJob job;
+                job.inputPath = it->path().string();
+                job.outputDir = opts.outputDir.empty() ? "" : (fs::path(opts.outputDir) / rel).string();
+                job.packPrefix = rel.generic_string() + "/";
+                job.size = it->file_size(ec);
+                found.push_back(job);
+            }
+            std::sort(found.begin(), found.end(), [](const BatchJob& a, const BatchJob& b) {
+                return a.inputPath < b.inputPath;
+            });
+            jobs.insert(jobs.end(), found.begin(), found.end());
+        } else if (fs::is_regular_file(input, ec)) {
+            BatchJob job;
+            job.inputPath = input;
+            std::string stem = fs::path(input).stem().string();
+            job.outputDir = singleFile || opts.outputDir.empty() ? opts.outputDir
+                                                                 : (fs::path(opts.outputDir) / stem).string();
+            job.packPrefix = singleFile ? "" : stem + "/";
+            job.size = fs::file_size(input, ec);
+            jobs.push_back(job);
+        } else {
+            std::cerr << "Warning: skipping " << input << " (not found)" << std::endl;
+        }
+    }
+    return jobs;
+}
+
+// ============================================================================
+// SHARDING
+// ============================================================================
+
+// Rough cost of one texture beyond its bytes (parse, file creation, write).
+const u64 SHARD_TEXTURE_COST = 64 * 1024;
+
+// Reads just enough of the header to get the texture count; 0 if unreadable.
+u32 peekTextureCount(const std::string& path) {
+    u8 head[0x28];
+    std::ifstream file(path, std::ios::binary);
+    if (!file.read(reinterpret_cast<char*>(head), sizeof(head))) return 0;
+    if (std::memcmp(head, "BNTX", 4) != 0 || std::memcmp(head + 0x20, "NX  ", 4) != 0) return 0;
+    bool bigEndian;
+    if (!readByteOrder(head, bigEndian)) return 0;
+    return bigEndian ? BigEndian::read32(head + 0x24) : LittleEndian::read32(head + 0x24);
+}
+
+// Deterministic greedy partition: heaviest jobs first, each onto the currently
+// lightest shard. Every agent given the same inputs computes the same split
+// without coordination.
+std::vector<BatchJob> selectShard(std::vector<BatchJob> jobs, u32 index, u32 count) {
+    for (auto& job : jobs) {
+        job.work = job.size + (u64)peekTextureCount(job.inputPath) * SHARD_TEXTURE_COST;
+    }
+    std::sort(jobs.begin(), jobs.end(), [](const BatchJob& a, const BatchJob& b) {
+        if (a.work != b.work) return a.work > b.work;
+        return a.inputPath < b.inputPath;
+    });
+
+    std::vector<u64> load(count, 0);
+    std::vector<BatchJob> mine;
+    for (auto& job : jobs) {
+        u32 lightest = (u32)(std::min_element(load.begin(), load.end()) - load.begin());
+        load[lightest] += job.work;
+        if (lightest == index) mine.push_back(job);
+    }
+
+    std::sort(mine.begin(), mine.end(), [](const BatchJob& a, const BatchJob& b) {
+        return a.inputPath < b.inputPath;
+    });
+    return mine;
+}
+
+// Reads and parses one input and prepares its output directory.
+// With keepFile set, texture data is not copied out; the file buffer is handed
+// back instead so the caller can copy each span when it admits that texture.
+bool loadJob(const BatchJob& job, std::vector<BNTXTexture>& textures, std::string& error,
+             FileMemory* memory = nullptr, FileBuffer* keepFile = nullptr) {
+    FileBuffer fileData;
+    bool ok;
+    {
+        StageTimer timer(STAGE_READ);
+        ok = readFile(job.inputPath, fileData);
+    }
+    if (!ok) {
+        error = "file couldnt be read";
+        metrics.errors[ERROR_READ].add(1);
+        return false;
+    }
+    progress.bytesIn.fetch_add(fileData.size(), std::memory_order_relaxed);
+    metrics.bytesRead.add(fileData.size());
+
+    {
+        StageTimer timer(STAGE_PARSE);
+        textures = parseBNTX(fileData, keepFile == nullptr);
+    }
+    if (textures.empty()) {
+        error = "no textures found";
+        metrics.errors[ERROR_PARSE].add(1);
+        return false;
+    }
+
+    if (memory) {
+        memory->fileBuffer = fileData.capacity();
+        for (const auto& tex : textures) memory->textureData += tex.imageSize;
+    }
+
+    std::error_code ec;
+    if (!job.outputDir.empty()) std::filesystem::create_directories(job.outputDir, ec);
+    if (ec) {
+        error = "cannot create " + job.outputDir + ": " + ec.message();
+        metrics.errors[ERROR_WRITE].add(1);
+        return false;
+    }
+
+    if (keepFile) *keepFile = std::move(fileData);
+    return true;
+}
+
+bool extractFile(const BatchJob& job, std::string& error, std::vector<ManifestEntry>& written,
+                 FileMemory& memory) {
+    std::vector<BNTXTexture> textures;
+    if (!loadJob(job, textures, error, &memory)) return false;
+
+    for (const auto& tex : textures) {
+        EncodedTexture enc;
+        if (!encodeTexture(tex, enc)) continue;
+        memory.untiled += enc.payload.capacity();
+        memory.headers += enc.header.capacity();
+        writeTexture(enc, job.outputDir, &written);
+    }
+    for (auto& entry : written) entry.input = job.inputPath;
+    return true;
+}
+
+void runThreadWorkers(const std::vector<BatchJob>& jobs, unsigned workerCount,
+                      std::vector<std::unique_ptr<WorkerSlot>>& slots, FailureLog& failures,
+                      Manifest& manifest, MemoryReport& memoryReport) {
+    std::atomic<size_t> nextJob{0};
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < workerCount; w++) {
+        workers.emplace_back([&, w] {
+            tileMipsOverThreads = workerCount <= 1;
+            WorkerSlot& slot = *slots[w];
+            for (size_t i = nextJob++; i < jobs.size(); i = nextJob++) {
+                slot.begin(jobs[i].inputPath);
+                std::string error;
+                std::vector<ManifestEntry> written;
+                FileMemory memory;
+                if (!extractFile(jobs[i], error, written, memory)) {
+                    std::cerr << jobs[i].inputPath << ": " << error << std::endl;
+                    failures.add(jobs[i].inputPath, error);
+                }
+                manifest.add(written);
+                memoryReport.add(jobs[i].inputPath, memory, memoryStats.totalPeak.load(), peakRSS());
+                progress.filesDone.fetch_add(1, std::memory_order_relaxed);
+                metrics.filesProcessed.add(1);
+                slot.end();
+            }
+        });
+    }
+    for (auto& t : workers) t.join();
+}
+
+// ============================================================================
+// I/O PLANNER
+// ============================================================================
+
+// Textures whose spans are at most this far apart are fetched in one read.
+const u64 IO_MAX_GAP = 64 * 1024;
+// Target size of one coalesced read.
+const u64 IO_READ_SIZE = 8 * 1024 * 1024;
+// How far ahead of the current read the kernel is asked to prefetch.
+const u64 IO_READAHEAD = 32 * 1024 * 1024;
+const size_t IO_MAX_PARTS = 512;
+
+// Positional reads with access-pattern hints where the platform has them.
+class InputFile {
+public:
+    ~InputFile() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        stream.open(path, std::ios::binary | std::ios::ate);
+        if (!stream.is_open()) return false;
+        fileSize = (u64)stream.tellg();
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) return false;
+        fileSize = (u64)st.st_size;
+        device = (u64)st.st_dev;
+        inode = (u64)st.st_ino;
+#endif
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (stream.is_open()) stream.close();
+#else
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+    }
+
+    u64 size() const { return fileSize; }
+
+    bool readAt(u64 offset, u8* dst, size_t len) {
+        std::pair<u8*, size_t> part(dst, len);
+        return readScattered(offset, &part, 1);
+    }
+
+    // Reads one contiguous range into several buffers with a single request.
+    bool readScattered(u64 offset, std::pair<u8*, size_t>* parts, size_t count) {
+#ifdef _WIN32
+        stream.seekg((std::streamoff)offset);
+        for (size_t i = 0; i < count; i++) {
+            if (!stream.read(reinterpret_cast<char*>(parts[i].first), parts[i].second)) return false;
+        }
+        return true;
+#else
+        std::vector<iovec> iov(count);
+        size_t total = 0;
+        for (size_t i = 0; i < count; i++) {
+            iov[i].iov_base = parts[i].first;
+            iov[i].iov_len = parts[i].second;
+            total += parts[i].second;
+        }
+        size_t first = 0;
+        while (total > 0) {
+            ssize_t n = preadv(fd, &iov[first], (int)(count - first), (off_t)offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            offset += n;
+            total -= n;
+            // Short read: skip the filled iovecs and trim the partial one
+            while (n > 0 && first < count) {
+                size_t take = std::min<size_t>(n, iov[first].iov_len);
+                iov[first].iov_base = (u8*)iov[first].iov_base + take;
+                iov[first].iov_len -= take;
+                n -= take;
+                if (iov[first].iov_len == 0) first++;
+            }
+        }
+        return true;
+#endif
+    }
+
+    void adviseSequential() {
+#ifdef __linux__
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    }
+
+    void willNeed(u64 offset, u64 len) {
+#ifdef __linux__
+        posix_fadvise(fd, (off_t)offset, (off_t)len, POSIX_FADV_WILLNEED);
+#else
+        (void)offset;
+        (void)len;
+#endif
+    }
+
+    // Sort key approximating where the file sits on disk: the physical address
+    // of its first extent where FIEMAP works, otherwise device and inode.
+    std::pair<u64, u64> physicalOrder() {
+#ifdef __linux__
+        alignas(fiemap) u8 buf[sizeof(fiemap) + sizeof(fiemap_extent)] = {};
+        fiemap* map = reinterpret_cast<fiemap*>(buf);
+        map->fm_start = 0;
+        map->fm_length = ~0ULL;
+        map->fm_extent_count = 1;
+        if (ioctl(fd, FS_IOC_FIEMAP, map) == 0 && map->fm_mapped_extents > 0) {
+            return {device, map->fm_extents[0].fe_physical};
+        }
+#endif
+        return {device, inode};
+    }
+
+private:
+#ifdef _WIN32
+    std::ifstream stream;
+#else
+    int fd = -1;
+#endif
+    u64 fileSize = 0;
+    u64 device = 0;
+    u64 inode = 0;
+};
+
+// One input after the header pass: its metadata, with texture spans in file order.
+struct PlannedFile {
+    size_t job;
+    std::pair<u64, u64> order;
+    std::vector<BNTXTexture> textures;
+    FileMemory memory;
+    std::string error;
+};
+
+// Reads everything in front of the data block: BNTX and NX headers, BRTIs and
+// the string table. Texture spans are left for the planned reads.
+bool scanHeaders(InputFile& in, PlannedFile& plan) {
+    u64 fileSize = in.size();
+    u8 head[0x38];
+    if (fileSize < sizeof(head) || !in.readAt(0, head, sizeof(head))) {
+        plan.error = "file couldnt be read";
+        return false;
+    }
+
+    // Everything in front of BRTD, or the whole file if the NX header is unusable
+    u64 headerSize = fileSize;
+    bool bigEndian;
+    if (std::memcmp(head + 0x20, "NX  ", 4) == 0 && readByteOrder(head, bigEndian)) {
+        i64 dataBlkAddr = bigEndian ? BigEndian::read64Signed(head + 0x30) : LittleEndian::read64Signed(head + 0x30);
+        if (dataBlkAddr >= 0x100 && (u64)dataBlkAddr < fileSize) headerSize = (u64)dataBlkAddr;
+    }
+
+    FileBuffer header(headerSize);
+    bool ok;
+    {
+        StageTimer timer(STAGE_READ);
+        ok = in.readAt(0, header.data(), header.size());
+    }
+    if (!ok) {
+        plan.error = "file couldnt be read";
+        metrics.errors[ERROR_READ].add(1);
+        return false;
+    }
+    progress.bytesIn.fetch_add(headerSize, std::memory_order_relaxed);
+    metrics.bytesRead.add(headerSize);
+
+    {
+        StageTimer timer(STAGE_PARSE);
+        plan.textures = parseBNTX(header, false, fileSize);
+    }
+    if (plan.textures.empty()) {
+        plan.error = "no textures found";
+        metrics.errors[ERROR_PARSE].add(1);
+        return false;
+    }
+
+    std::stable_sort(plan.textures.begin(), plan.textures.end(), [](const BNTXTexture& a, const BNTXTexture& b) {
+        return a.dataOffset < b.dataOffset;
+    });
+
+    plan.memory.fileBuffer = header.capacity();
+    for (const auto& tex : plan.textures) plan.memory.textureData += tex.imageSize;
+    return true;
+}
+
+// Header pass over all inputs, visited and returned in on-disk order so the
+// data pass that follows sweeps the storage sequentially.
+std::vector<PlannedFile> planReads(const std::vector<BatchJob>& jobs) {
+    std::vector<PlannedFile> plans(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++) {
+        plans[i].job = i;
+        InputFile in;
+        if (in.open(jobs[i].inputPath)) plans[i].order = in.physicalOrder();
+    }
+    std::stable_sort(plans.begin(), plans.end(), [](const PlannedFile& a, const PlannedFile& b) {
+        return a.order < b.order;
+    });
+
+    for (auto& plan : plans) {
+        InputFile in;
+        if (!in.open(jobs[plan.job].inputPath)) {
+            plan.error = "file couldnt be read";
+            metrics.errors[ERROR_READ].add(1);
+            continue;
+        }
+        scanHeaders(in, plan);
+    }
+    return plans;
+}
+
+// Splits a file's offset-sorted textures into runs fetched by single reads:
+// neighbours closer than IO_MAX_GAP are merged up to IO_READ_SIZE.
+std::vector<std::pair<size_t, size_t>> coalesceRuns(const std::vector<BNTXTexture>& textures) {
+    std::vector<std::pair<size_t, size_t>> runs;
+    size_t begin = 0;
+    for (size_t i = 1; i <= textures.size(); i++) {
+        if (i < textures.size()) {
+            const BNTXTexture& prev = textures[i - 1];
+            const BNTXTexture& cur = textures[i];
+            u64 prevEnd = prev.dataOffset + prev.imageSize;
+            u64 runStart = textures[begin].dataOffset;
+            bool adjacent = cur.dataOffset >= prevEnd && cur.dataOffset - prevEnd <= IO_MAX_GAP;
+            bool fits = cur.dataOffset + cur.imageSize - runStart <= IO_READ_SIZE;
+            if (adjacent && fits && i - begin < IO_MAX_PARTS / 2) continue;
+        }
+        runs.emplace_back(begin, i);
+        begin = i;
+    }
+    return runs;
+}
+
+// ============================================================================
+// CPU TOPOLOGY
+// ============================================================================
+
+// Usable CPUs grouped by NUMA node, from /sys. Within a node one hardware
+// thread of every physical core comes first, so workers only share cores
+// once there are more workers than cores.
+struct CpuTopology {
+    std::vector<std::vector<int>> nodes;
+
+    size_t cpuCount() const {
+        size_t n = 0;
+        for (const auto& cpus : nodes) n += cpus.size();
+        return n;
+    }
+
+    // Workers alternate between nodes and fill each node's CPUs in order.
+    size_t nodeOf(unsigned worker, size_t nodeCount) const { return worker % nodeCount; }
+    int cpuFor(unsigned worker, size_t nodeCount) const {
+        const auto& cpus = nodes[nodeOf(worker, nodeCount)];
+        return cpus[(worker / nodeCount) % cpus.size()];
+    }
+};
+
+std::string readSysFile(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::istringstream in(list);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+        if (range.empty()) continue;
+        size_t dash = range.find('-');
+        int first = std::atoi(range.c_str());
+        int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+        for (int c = first; c <= last; c++) cpus.push_back(c);
+    }
+    return cpus;
+}
+
+CpuTopology discoverTopology() {
+    namespace fs = std::filesystem;
+    CpuTopology topo;
+    std::vector<std::pair<int, std::vector<int>>> found;
+    std::error_code ec;
+    for (fs::directory_iterator it("/sys/devices/system/node", ec), end; it != end; it.increment(ec)) {
+        if (ec) break;
+        std::string name = it->path().filename().string();
+        if (name.size() < 5 || name.compare(0, 4, "node") != 0 || !std::isdigit((unsigned char)name[4])) continue;
+        std::vector<int> cpus = parseCpuList(readSysFile(it->path().string() + "/cpulist"));
+        if (!cpus.empty()) found.emplace_back(std::atoi(name.c_str() + 4), cpus);   // memory-only nodes have none
+    }
+    std::sort(found.begin(), found.end());
+    if (found.empty()) {
+        std::vector<int> cpus = parseCpuList(readSysFile("/sys/devices/system/cpu/online"));
+        if (cpus.empty()) {
+            for (unsigned c = 0; c < std::max(1u, std::thread::hardware_concurrency()); c++) cpus.push_back((int)c);
+        }
+        found.emplace_back(0, cpus);
+    }
+
+#ifdef __linux__
+    cpu_set_t allowed;
+    bool haveMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+#endif
+    for (auto& node : found) {
+        std::vector<int> primary, siblings;
+        for (int cpu : node.second) {
+#ifdef __linux__
+            if (haveMask && (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))) continue;
+#endif
+            std::vector<int> thread = parseCpuList(readSysFile("/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                                                               "/topology/thread_siblings_list"));
+            bool first = thread.empty() || *std::min_element(thread.begin(), thread.end()) == cpu;
+            (first ? primary : siblings).push_back(cpu);
+        }
+        primary.insert(primary.end(), siblings.begin(), siblings.end());
+        if (!primary.empty()) topo.nodes.push_back(primary);
+    }
+    return topo;
+}
+
+// Restricts the calling thread to cpus; false where that is not supported.
+bool bindCurrentThread(const std::vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+// ============================================================================
+// PIPELINED EXTRACTION
+// ============================================================================
+
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+    // Blocks while full; false once the queue is closed.
+    bool push(T item) {
+        std::unique_lock<std::mutex> guard(lock);
+        notFull.wait(guard, [this] { return closed || items.size() < capacity; });
+        if (closed) return false;
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Blocks while empty; false once the queue is closed and drained.
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> guard(lock);
+        notEmpty.wait(guard, [this] { return closed || !items.empty(); });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+private:
+    std::deque<T> items;
+    size_t capacity;
+    bool closed = false;
+    std::mutex lock;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+};
+
+// Admission control: a texture enters the pipeline only once its estimated
+// working set fits in the budget, so many small textures run in parallel while
+// huge ones are throttled instead of exhausting memory.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(u64 limit) : limit(limit) {}
+
+    // Blocks until bytes fit. held is what the caller already holds itself, so
+    // an item larger than the whole budget is still admitted once nothing else
+    // is in flight rather than waiting forever.
+    void acquire(u64 bytes, u64 held = 0) {
+        std::unique_lock<std::mutex> guard(lock);
+        if (limit) {
+            freed.wait(guard, [&] { return used + bytes <= limit || used <= held; });
+        }
+        used += bytes;
+        peak = std::max(peak, used);
+    }
+
+    void release(u64 bytes) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            used -= bytes;
+        }
+        freed.notify_all();
+    }
+
+    u64 peakUsed() {
+        std::lock_guard<std::mutex> guard(lock);
+        return peak;
+    }
+
+private:
+    u64 limit;
+    u64 used = 0;
+    u64 peak = 0;
+    std::mutex lock;
+    std::condition_variable freed;
+};
+
+struct UntileTask {
+    size_t job;
+    BNTXTexture tex;
+    u64 reserved;
+    bool loaded;
+};
+
+struct PipelineOptions {
+    unsigned workers = 1;
+    bool planIO = true;
+    MemoryBudget* budget = nullptr;
+    TexPackWriter* pack = nullptr;
+    const CpuTopology* topology = nullptr;  // pin workers; see runPipeline
+};
+
+struct WriteTask {
+    size_t job;
+    bool encoded;
+    EncodedTexture enc;
+    u64 reserved;
+};
+
+// Extraction as three overlapping stages: a reader thread reads and parses the
+// next file while the untile workers process the current textures and a writer
+// thread stores finished ones. Regular files are always "ready" to epoll, so
+// blocking stages on threads is what actually overlaps disk I/O with untiling.
+//
+// With planIO the reader first scans all headers in on-disk order, then fetches
+// texture spans sorted by offset with large coalesced reads and prefetch hints
+// instead of reading every file whole.
+//
+// With a topology every worker is pinned to one CPU and each NUMA node gets its
+// own untile queue. The reader assigns each texture (or coalesced run) to the
+// node with the fewest bytes so far and moves itself onto that node before
+// allocating the texture's input span, so first touch places the input, the
+// worker and the untiled output it allocates on the same node.
+void runPipeline(const std::vector<BatchJob>& jobs, const PipelineOptions& opts,
+                 std::vector<std::unique_ptr<WorkerSlot>>& slots, FailureLog& failures,
+                 Manifest& manifest, MemoryReport& memoryReport) {
+    unsigned workerCount = opts.workers;
+    MemoryBudget& budget = *opts.budget;
+    struct FileState {
+        size_t remaining = 0;
+        std::vector<ManifestEntry> written;
+        FileMemory memory;
+    };
+    std::vector<FileState> files(jobs.size());
+
+    const CpuTopology* topology = opts.topology;
+    size_t nodeCount = topology ? std::min<size_t>(topology->nodes.size(), workerCount) : 1;
+    std::vector<std::unique_ptr<BoundedQueue<UntileTask>>> untileQueues;
+    for (size_t n = 0; n < nodeCount; n++) {
+        untileQueues.push_back(std::make_unique<BoundedQueue<UntileTask>>(workerCount * 2 / nodeCount + 1));
+    }
+    BoundedQueue<WriteTask> writeQueue(workerCount * 2);
+    
+    // Reader side of the placement: picks a node and moves the reader onto it.
+    std::vector<u64> nodeBytes(nodeCount, 0);
+    size_t readerNode = SIZE_MAX;
+    auto placeOnNode = [&](u64 bytes) {
+        size_t node = std::min_element(nodeBytes.begin(), nodeBytes.end()) - nodeBytes.begin();
+        nodeBytes[node] += bytes;
+        if (topology && node != readerNode) {
+            bindCurrentThread(topology->nodes[node]);
+            readerNode = node;
+        }
+        return node;
+    };
+
+    auto failFile = [&](size_t i, const std::string& error) {
+        std::cerr << jobs[i].inputPath << ": " << error << std::endl;
+        failures.add(jobs[i].inputPath, error);
+        progress.filesDone.fetch_add(1, std::memory_order_relaxed);
+        metrics.filesProcessed.add(1);
+    };
+
+    auto readWholeFiles = [&] {
+        for (size_t i = 0; i < jobs.size(); i++) {
+            const BatchJob& job = jobs[i];
+            std::string error;
+            std::vector<BNTXTexture> textures;
+            FileBuffer fileData;
+            u64 fileReserved = job.size;
+            budget.acquire(fileReserved);
+            if (!loadJob(job, textures, error, &files[i].memory, &fileData)) {
+                budget.release(fileReserved);
+                failFile(i, error);
+                continue;
+            }
+
+            // Set before the first push; the queue hands it over to the writer
+            files[i].remaining = textures.size();
+            for (auto& tex : textures) {
+                u64 reserved = estimateWorkingSet(tex, opts.pack);
+                budget.acquire(reserved, fileReserved);
+                size_t node = placeOnNode(tex.imageSize);
+                const u8* span = fileData.data() + tex.dataOffset;
+                tex.data.assign(span, span + tex.imageSize);
+                untileQueues[node]->push({i, std::move(tex), reserved, true});
+            }
+            fileData = FileBuffer();
+            budget.release(fileReserved);
+        }
+    };
+
+    auto readPlanned = [&] {
+        std::vector<PlannedFile> plans = planReads(jobs);
+        std::vector<u8> gap(IO_MAX_GAP);
+
+        for (auto& plan : plans) {
+            size_t i = plan.job;
+            const BatchJob& job = jobs[i];
+            files[i].memory = plan.memory;
+
+            InputFile in;
+            std::error_code ec;
+            if (plan.error.empty() && !in.open(job.inputPath)) {
+                plan.error = "file couldnt be read";
+            }
+            if (plan.error.empty() && !job.outputDir.empty() &&
+                (std::filesystem::create_directories(job.outputDir, ec), ec)) {
+                plan.error = "cannot create " + job.outputDir + ": " + ec.message();
+                metrics.errors[ERROR_WRITE].add(1);
+            }
+            if (!plan.error.empty()) {
+                failFile(i, plan.error);
+                continue;
+            }
+
+            in.adviseSequential();
+            files[i].remaining = plan.textures.size();
+            bool readFailed = false;
+
+            for (const auto& run : coalesceRuns(plan.textures)) {
+                u64 start = plan.textures[run.first].dataOffset;
+                const BNTXTexture& last = plan.textures[run.second - 1];
+                u64 end = last.dataOffset + last.imageSize;
+                in.willNeed(end, IO_READAHEAD);
+                size_t node = placeOnNode(end - start);
+
+                // Nothing in the run is queued before it is read, so what the
+                // run already holds counts as held: a run larger than the whole
+                // budget then waits only for everything else, not for itself.
+                std::vector<u64> reserved;
+                std::vector<std::pair<u8*, size_t>> parts;
+                u64 cursor = start, runHeld = 0;
+                for (size_t k = run.first; k < run.second; k++) {
+                    BNTXTexture& tex = plan.textures[k];
+                    reserved.push_back(estimateWorkingSet(tex, opts.pack));
+                    budget.acquire(reserved.back(), runHeld);
+                    runHeld += reserved.back();
+                    tex.data.resize(tex.imageSize);
+                    if (tex.dataOffset > cursor) parts.emplace_back(gap.data(), tex.dataOffset - cursor);
+                    parts.emplace_back(tex.data.data(), tex.imageSize);
+                    cursor = tex.dataOffset + tex.imageSize;
+                }
+
+                bool ok = !readFailed;
+                if (ok) {
+                    StageTimer timer(STAGE_READ);
+                    ok = in.readScattered(start, parts.data(), parts.size());
+                }
+                if (ok) {
+                    progress.bytesIn.fetch_add(end - start, std::memory_order_relaxed);
+                    metrics.bytesRead.add(end - start);
+                } else if (!readFailed) {
+                    readFailed = true;
+                    std::cerr << job.inputPath << ": read error" << std::endl;
+                    failures.add(job.inputPath, "read error");
+                    metrics.errors[ERROR_READ].add(1);
+                }
+
+                for (size_t k = run.first; k < run.second; k++) {
+                    untileQueues[node]->push({i, std::move(plan.textures[k]), reserved[k - run.first], ok});
+                }
+            }
+        }
+    };
+
+    std::thread reader([&] {
+        if (opts.planIO) readPlanned();
+        else readWholeFiles();
+        for (auto& queue : untileQueues) queue->close();
+    });
+
+    std::vector<std::thread> untilers;
+    for (unsigned w = 0; w < workerCount; w++) {
+        untilers.emplace_back([&, w] {
+            if (topology) bindCurrentThread({topology->cpuFor(w, nodeCount)});
+            tileMipsOverThreads = workerCount <= 1 && !topology;
+            BoundedQueue<UntileTask>& untileQueue = *untileQueues[w % nodeCount];
+            WorkerSlot& slot = *slots[w];
+            UntileTask task;
+            while (untileQueue.pop(task)) {
+                slot.begin(jobs[task.job].inputPath + ":" + task.tex.name);
+                WriteTask out;
+                out.job = task.job;
+                out.reserved = task.reserved;
+                out.encoded = task.loaded && encodeTexture(task.tex, out.enc);
+                if (out.encoded && opts.pack) opts.pack->encode(out.enc);
+                task.tex.data = TextureBuffer();
+                slot.end();
+                writeQueue.push(std::move(out));
+            }
+        });
+    }
+
+    std::thread writer([&] {
+        WriteTask task;
+        while (writeQueue.pop(task)) {
+            FileState& file = files[task.job];
+            if (task.encoded) {
+                file.memory.untiled += task.enc.payload.capacity() + task.enc.packed.capacity();
+                file.memory.headers += task.enc.header.capacity();
+                if (opts.pack && !skipTexture(task.enc)) opts.pack->add(jobs[task.job].packPrefix + task.enc.name, task.enc);
+                size_t firstNew = file.written.size();
+                if (jobs[task.job].outputDir.empty()) progress.texturesDone.fetch_add(1, std::memory_order_relaxed);
+                else writeTexture(task.enc, jobs[task.job].outputDir, &file.written);
+                for (size_t k = firstNew; k < file.written.size(); k++) file.written[k].input = jobs[task.job].inputPath;
+            }
+            task.enc = EncodedTexture();
+            budget.release(task.reserved);
+            if (--file.remaining == 0) {
+                manifest.add(file.written);
+                memoryReport.add(jobs[task.job].inputPath, file.memory, memoryStats.totalPeak.load(), peakRSS());
+                progress.filesDone.fetch_add(1, std::memory_order_relaxed);
+                metrics.filesProcessed.add(1);
+            }
+        }
+    });
+
+    reader.join();
+    for (auto& t : untilers) t.join();
+    writeQueue.close();
+    writer.join();
+}
+
+// ============================================================================
+// CRASH-ISOLATED WORKERS
+// ============================================================================
+
+#ifndef _WIN32
+
+// Sent back by a worker process for every finished job, followed by
+// manifestBytes of manifest rows (one per line).
+struct WorkerResult {
+    u32 ok;
+    u32 manifestBytes;
+    u64 textures;
+    u64 bytesIn;
+    u64 bytesOut;
+    u64 bytesUntiled;
+    u64 errors[ERROR_COUNT];
+    FileMemory memory;
+    u64 stagePeak[MEM_STAGE_COUNT];
+    u64 trackedPeak;
+    u64 peakRSS;
+    char error[256];
+};
+
+struct WorkerProcess {
+    pid_t pid = -1;
+    int toChild = -1;
+    int fromChild = -1;
+    i64 job = -1;
+    std::chrono::steady_clock::time_point start;
+};
+
+bool readFull(int fd, void* buf, size_t len) {
+    u8* p = (u8*)buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool writeFull(int fd, const void* buf, size_t len) {
+    const u8* p = (const u8*)buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Worker process body: extracts job indices read from the pipe until it closes.
+[[noreturn]] void workerMain(const std::vector<BatchJob>& jobs, int in, int out) {
+    u64 index;
+    while (readFull(in, &index, sizeof(index))) {
+        WorkerResult result = {};
+        u64 textures = progress.texturesDone, bytesIn = progress.bytesIn, bytesOut = progress.bytesOut;
+        u64 bytesUntiled = metrics.bytesUntiled.total();
+        u64 errors[ERROR_COUNT];
+        for (int e = 0; e < ERROR_COUNT; e++) errors[e] = metrics.errors[e].total();
+        std::string error;
+        std::vector<ManifestEntry> written;
+        try {
+            result.ok = extractFile(jobs[index], error, written, result.memory);
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        std::string rows;
+        for (const auto& entry : written) rows += entry.toLine() + "\n";
+        result.manifestBytes = (u32)rows.size();
+        result.textures = progress.texturesDone - textures;
+        result.bytesIn = progress.bytesIn - bytesIn;
+        result.bytesOut = progress.bytesOut - bytesOut;
+        result.bytesUntiled = metrics.bytesUntiled.total() - bytesUntiled;
+        for (int e = 0; e < ERROR_COUNT; e++) result.errors[e] = metrics.errors[e].total() - errors[e];
+        for (int st = 0; st < MEM_STAGE_COUNT; st++) result.stagePeak[st] = memoryStats.peak[st].load();
+        result.trackedPeak = memoryStats.totalPeak.load();
+        result.peakRSS = peakRSS();
+        std::strncpy(result.error, error.c_str(), sizeof(result.error) - 1);
+        if (!writeFull(out, &result, sizeof(result))) break;
+        if (!writeFull(out, rows.data(), rows.size())) break;
+    }
+    _exit(0);
+}
+
+// Starts a worker for pool[wi]. The child closes the pipes it inherited for the
+// other workers, or a worker would never see its own pipe close.
+bool spawnWorker(std::vector<WorkerProcess>& pool, size_t wi, const std::vector<BatchJob>& jobs) {
+    WorkerProcess& w = pool[wi];
+    int down[2], up[2];
+    if (pipe(down) != 0) return false;
+    if (pipe(up) != 0) {
+        close(down[0]);
+        close(down[1]);
+        return false;
+    }
+
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(down[0]); close(down[1]); close(up[0]); close(up[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(down[1]);
+        close(up[0]);
+        for (const auto& other : pool) {
+            if (other.pid < 0) continue;
+            close(other.toChild);
+            close(other.fromChild);
+        }
+        workerMain(jobs, down[0], up[1]);
+    }
+
+    close(down[0]);
+    close(up[1]);
+    w.pid = pid;
+    w.toChild = down[1];
+    w.fromChild = up[0];
+    w.job = -1;
+    return true;
+}
+
+// Kills (if needed) and reaps a worker; returns a description of how it ended.
+std::string reapWorker(WorkerProcess& w, bool kill) {
+    if (kill) ::kill(w.pid, SIGKILL);
+    close(w.toChild);
+    close(w.fromChild);
+
+    int status = 0;
+    while (waitpid(w.pid, &status, 0) < 0 && errno == EINTR) {}
+    w.pid = -1;
+
+    if (WIFSIGNALED(status)) {
+        int sig = WTERMSIG(status);
+        const char* name = strsignal(sig);
+        return "worker crashed (signal " + std::to_string(sig) + (name ? std::string(", ") + name : "") + ")";
+    }
+    return "worker exited with status " + std::to_string(WEXITSTATUS(status));
+}
+
+// Runs the batch in a pool of forked processes fed job indices over pipes. The
+// parent stays single-threaded (periodic work runs from its poll loop through
+// onTick) so respawning workers with fork() is safe at any point.
+//
+// Workers report byte, error, per-format and memory peak counts back with each
+// result; stage latencies are only recorded for in-process extraction. Returns
+// the largest peak RSS any worker reported.
+u64 runIsolatedWorkers(const std::vector<BatchJob>& jobs, unsigned workerCount, u32 timeoutSec,
+                        std::vector<std::unique_ptr<WorkerSlot>>& slots, const std::function<void()>& onTick,
+                        FailureLog& failures, Manifest& manifest, MemoryReport& memoryReport) {
+    signal(SIGPIPE, SIG_IGN);
+    // Inherited by the forked workers; this thread never extracts itself.
+    tileMipsOverThreads = workerCount <= 1;
+
+    std::vector<WorkerProcess> workers(workerCount);
+    size_t nextJob = 0;
+    size_t finished = 0;
+    u64 workerRSS = 0;
+    auto timeout = std::chrono::seconds(timeoutSec);
+
+    auto fail = [&](WorkerProcess& w, const std::string& reason) {
+        const std::string& path = jobs[w.job].inputPath;
+        std::cerr << path << ": " << reason << std::endl;
+        failures.add(path, reason);
+        progress.filesDone.fetch_add(1, std::memory_order_relaxed);
+        metrics.filesProcessed.add(1);
+        finished++;
+    };
+
+    auto dispatch = [&](size_t wi) {
+        WorkerProcess& w = workers[wi];
+        while (nextJob < jobs.size()) {
+            if (w.pid < 0 && !spawnWorker(workers, wi, jobs)) {
+                std::cerr << "Error: cannot start worker process: " << std::strerror(errno) << std::endl;
+                return;
+            }
+            u64 index = nextJob;
+            if (writeFull(w.toChild, &index, sizeof(index))) {
+                nextJob++;
+                w.job = (i64)index;
+                w.start = std::chrono::steady_clock::now();
+                slots[wi]->begin(jobs[index].inputPath);
+                return;
+            }
+            reapWorker(w, true);
+        }
+    };
+
+    for (size_t wi = 0; wi < workers.size(); wi++) dispatch(wi);
+
+    while (finished < jobs.size()) {
+        std::vector<pollfd> fds;
+        std::vector<size_t> owners;
+        for (size_t wi = 0; wi < workers.size(); wi++) {
+            if (workers[wi].pid < 0 || workers[wi].job < 0) continue;
+            fds.push_back({workers[wi].fromChild, POLLIN, 0});
+            owners.push_back(wi);
+        }
+        if (fds.empty()) {
+            // Could not keep any worker alive; fail what is left rather than spin
+            for (; nextJob < jobs.size(); nextJob++) {
+                failures.add(jobs[nextJob].inputPath, "no worker process available");
+                progress.filesDone.fetch_add(1, std::memory_order_relaxed);
+                finished++;
+            }
+            break;
+        }
+
+        int waitMs = 200;
+        if (poll(fds.data(), fds.size(), waitMs) < 0 && errno != EINTR) break;
+        onTick();
+
+        auto now = std::chrono::steady_clock::now();
+        for (size_t k = 0; k < fds.size(); k++) {
+            size_t wi = owners[k];
+            WorkerProcess& w = workers[wi];
+
+            if (fds[k].revents & (POLLIN | POLLHUP | POLLERR)) {
+                WorkerResult result;
+                std::string rows;
+                bool received = readFull(w.fromChild, &result, sizeof(result));
+                if (received) {
+                    rows.resize(result.manifestBytes);
+                    received = readFull(w.fromChild, &rows[0], rows.size());
+                }
+                if (received) {
+                    std::vector<ManifestEntry> written;
+                    std::istringstream lines(rows);
+                    for (std::string line; std::getline(lines, line);) {
+                        ManifestEntry entry;
+                        if (!ManifestEntry::fromLine(line, entry)) continue;
+                        for (const auto& f : formats) {
+                            if (f.second == entry.format) metrics.texturesByFormat[f.first].add(1);
+                        }
+                        written.push_back(std::move(entry));
+                    }
+                    manifest.add(written);
+                    // Peaks are the worker process's, which is what a container limit sees per file
+                    memoryReport.add(jobs[w.job].inputPath, result.memory, result.trackedPeak, result.peakRSS);
+                    memoryStats.mergePeaks(result.stagePeak, result.trackedPeak);
+                    workerRSS = std::max(workerRSS, result.peakRSS);
+                    progress.texturesDone.fetch_add(result.textures, std::memory_order_relaxed);
+                    progress.bytesIn.fetch_add(result.bytesIn, std::memory_order_relaxed);
+                    progress.bytesOut.fetch_add(result.bytesOut, std::memory_order_relaxed);
+                    metrics.bytesRead.add(result.bytesIn);
+                    metrics.bytesWritten.add(result.bytesOut);
+                    metrics.bytesUntiled.add(result.bytesUntiled);
+                    for (int e = 0; e < ERROR_COUNT; e++) metrics.errors[e].add(result.errors[e]);
+                    if (result.ok) {
+                        progress.filesDone.fetch_add(1, std::memory_order_relaxed);
+                        metrics.filesProcessed.add(1);
+                        finished++;
+                    } else {
+                        result.error[sizeof(result.error) - 1] = 0;
+                        fail(w, result.error);
+                    }
+                } else {
+                    metrics.errors[ERROR_WORKER].add(1);
+                    fail(w, reapWorker(w, false));
+                }
+                slots[wi]->end();
+                w.job = -1;
+                dispatch(wi);
+            } else if (timeoutSec > 0 && now - w.start > timeout) {
+                reapWorker(w, true);
+                metrics.errors[ERROR_WORKER].add(1);
+                fail(w, "timed out after " + std::to_string(timeoutSec) + "s");
+                slots[wi]->end();
+                w.job = -1;
+                dispatch(wi);
+            }
+        }
+    }
+
+    for (auto& w : workers) {
+        if (w.pid < 0) continue;
+        close(w.toChild);
+        close(w.fromChild);
+        while (waitpid(w.pid, nullptr, 0) < 0 && errno == EINTR) {}
+    }
+    return workerRSS;
+}
+
+#endif
+
+int runBatch(int argc, char** argv) {
+    BatchOptions opts;
+    bool explicitVerbose = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " needs a value" << std::endl;
+                exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg == "-o" || arg == "--output") {
+            opts.outputDir = next();
+        } else if (arg == "-j" || arg == "--jobs") {
+            if (!parseOption(arg, next(), opts.jobs)) return 1;
+        } else if (arg == "--no-progress") {
+            opts.showProgress = false;
+        } else if (arg == "--progress-interval") {
+            if (!parseOption(arg, next(), opts.progressIntervalMs)) return 1;
+        } else if (arg == "--isolate") {
+            opts.isolate = true;
+        } else if (arg == "--timeout") {
+            if (!parseOption(arg, next(), opts.timeoutSec)) return 1;
+        } else if (arg == "--failed-log") {
+            opts.failedLog = next();
+        } else if (arg == "--manifest") {
+            opts.manifestPath = next();
+        } else if (arg == "--metrics") {
+            opts.metricsPath = next();
+        } else if (arg == "--memory-report") {
+            opts.memoryReportPath = next();
+        } else if (arg == "--memory-budget") {
+            u32 megabytes;
+            if (!parseOption(arg, next(), megabytes)) return 1;
+            opts.memoryBudget = (u64)megabytes * 1024 * 1024;
+        } else if (arg == "--no-io-plan") {
+            opts.planIO = false;
+        } else if (arg == "--pin") {
+            opts.pin = true;
+        } else if (arg == "--isa") {
+            if (!selectIsa(next())) return 1;
+        } else if (arg == "--read") {
+            if (!selectReadStrategy(next())) return 1;
+        } else if (arg == "--write") {
+            if (!selectWriteStrategy(next())) return 1;
+        } else if (arg == "--pack") {
+            opts.packPath = next();
+        } else if (arg == "--decode") {
+            decodeOptions.enabled = true;
+        } else if (arg == "--skip-solid") {
+            skipSolidTextures = true;
+        } else if (arg == "--gen-mips") {
+            generateMipChain = true;
+        } else if (arg == "--downscale") {
+            if (!parseOption(arg, next(), decodeOptions.scale)) return 1;
+            if (decodeOptions.scale == 0 || decodeOptions.scale > 16 || (decodeOptions.scale & (decodeOptions.scale - 1))) {
+                std::cerr << "Error: --downscale expects 1, 2, 4, 8 or 16" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--color-space") {
+            std::string space = next();
+            if (space == "srgb") decodeOptions.colorSpace = COLOR_SRGB;
+            else if (space == "linear") decodeOptions.colorSpace = COLOR_LINEAR;
+            else if (space == "keep") decodeOptions.colorSpace = COLOR_KEEP;
+            else {
+                std::cerr << "Error: --color-space expects srgb, linear or keep" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--normal-map") {
+            std::string mode = next();
+            if (mode == "rgb") decodeOptions.normalMap = NORMAL_RGB;
+            else if (mode == "rgba") decodeOptions.normalMap = NORMAL_RGBA;
+            else {
+                std::cerr << "Error: --normal-map expects rgb or rgba" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--pack-lz4") {
+            opts.packLZ4 = true;
+        } else if (arg == "--metrics-interval") {
+            if (!parseOption(arg, next(), opts.metricsIntervalSec)) return 1;
+            opts.metricsIntervalSec = std::max(1u, opts.metricsIntervalSec);
+        } else if (arg == "--shard") {
+            std::string spec = next();
+            size_t slash = spec.find('/');
+            if (slash == std::string::npos) {
+                opts.shardCount = 0;
+            } else if (!parseOption(arg, spec.substr(0, slash), opts.shardIndex) ||
+                       !parseOption(arg, spec.substr(slash + 1), opts.shardCount)) {
+                return 1;
+            }
+            if (opts.shardCount == 0 || opts.shardIndex >= opts.shardCount) {
+                std::cerr << "Error: --shard expects i/n with 0 <= i < n" << std::endl;
+                return 1;
+            }
+        } else if (arg == "-v" || arg == "--verbose") {
+            explicitVerbose = true;
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Error: unknown option " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        } else {
+            opts.inputs.push_back(arg);
+        }
+    }
+
+    if (opts.inputs.empty() || (opts.outputDir.empty() && opts.packPath.empty())) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (opts.isolate && !opts.packPath.empty()) {
+        std::cerr << "Error: --pack cannot be combined with --isolate" << std::endl;
+        return 1;
+    }
+
+    if (opts.jobs == 0) opts.jobs = std::max(1u, std::thread::hardware_concurrency());
+    verbose = explicitVerbose;
+    if (verbose) opts.showProgress = false;
+    if (!ioStrategySupported(ioOptions.read, ioOptions.write)) {
+        std::cerr << "Warning: " << READ_STRATEGY_NAMES[ioOptions.read] << " reads or "
+                  << WRITE_STRATEGY_NAMES[ioOptions.write] << " writes are unavailable here, using the fallback"
+                  << std::endl;
+    }
+
+#ifdef _WIN32
+    if (opts.isolate) {
+        std::cerr << "Error: --isolate is not supported on Windows" << std::endl;
+        return 1;
+    }
+#endif
+
+    std::vector<BatchJob> jobs = collectJobs(opts);
+    if (jobs.empty()) {
+        std::cerr << "Error: no .bntx files found" << std::endl;
+        return 1;
+    }
+
+    if (opts.shardCount > 1) {
+        size_t total = jobs.size();
+        jobs = selectShard(std::move(jobs), opts.shardIndex, opts.shardCount);
+        std::cerr << "Shard " << opts.shardIndex << "/" << opts.shardCount << ": "
+                  << jobs.size() << " of " << total << " files" << std::endl;
+        if (jobs.empty()) return 0;
+    }
+
+    progress.filesTotal = jobs.size();
+    for (const auto& job : jobs) progress.bytesTotal += job.size;
+
+    unsigned workerCount = std::min<unsigned>(opts.jobs, (unsigned)jobs.size());
+    std::vector<std::unique_ptr<WorkerSlot>> slots;
+    for (unsigned i = 0; i < workerCount; i++) slots.push_back(std::make_unique<WorkerSlot>());
+
+    ProgressReporter reporter(slots, std::chrono::milliseconds(opts.progressIntervalMs));
+    FailureLog failures;
+    Manifest manifest;
+    MemoryReport memoryReport;
+    MemoryBudget budget(opts.memoryBudget);
+
+    PeriodicTask metricsTask(std::chrono::seconds(opts.metricsIntervalSec), [&] {
+        if (!writeMetricsFile(opts.metricsPath)) std::cerr << "Failed to write " << opts.metricsPath << std::endl;
+    });
+    bool exportMetrics = !opts.metricsPath.empty();
+
+    u64 workerRSS = 0;
+    if (opts.isolate) {
+#ifndef _WIN32
+        if (opts.showProgress) reporter.startManual();
+        if (exportMetrics) metricsTask.startManual();
+        workerRSS = runIsolatedWorkers(jobs, workerCount, opts.timeoutSec, slots, [&] {
+            reporter.tick();
+            metricsTask.tick();
+        }, failures, manifest, memoryReport);
+#endif
+    } else {
+        if (opts.showProgress) reporter.start();
+        if (exportMetrics) metricsTask.start();
+        TexPackWriter pack;
+        if (!opts.packPath.empty() && !pack.open(opts.packPath, opts.packLZ4)) {
+            std::cerr << "Error: cannot create " << opts.packPath << std::endl;
+            return 1;
+        }
+
+        CpuTopology topology;
+        if (opts.pin) {
+            topology = discoverTopology();
+            std::cerr << "Pinning " << workerCount << " workers to " << topology.cpuCount() << " CPUs on "
+                      << topology.nodes.size() << " NUMA node(s)" << std::endl;
+        }
+        
+        PipelineOptions pipeline;
+        pipeline.workers = workerCount;
+        pipeline.planIO = opts.planIO;
+        pipeline.budget = &budget;
+        pipeline.pack = opts.packPath.empty() ? nullptr : &pack;
+        pipeline.topology = opts.pin && !topology.nodes.empty() ? &topology : nullptr;
+        runPipeline(jobs, pipeline, slots, failures, manifest, memoryReport);
+
+        if (pipeline.pack && !pack.finish()) {
+            std::cerr << "Failed to write " << opts.packPath << std::endl;
+            failures.add(opts.packPath, "pack write failed");
+        }
+    }
+
+    if (opts.showProgress) reporter.stop();
+    // With --isolate the peaks are the largest any single worker process saw
+    printMemorySummary(std::max(peakRSS(), workerRSS));
+    if (opts.memoryBudget && !opts.isolate) {
+        std::cerr << "Memory budget " << formatMB(opts.memoryBudget) << ", peak admitted "
+                  << formatMB(budget.peakUsed()) << std::endl;
+    }
+    if (metricsTask.stop() && !writeMetricsFile(opts.metricsPath)) {
+        std::cerr << "Failed to write " << opts.metricsPath << std::endl;
+    }
+
+    if (!opts.manifestPath.empty() && !manifest.write(opts.manifestPath)) {
+        std::cerr << "Failed to write " << opts.manifestPath << std::endl;
+    }
+    if (!opts.memoryReportPath.empty() && !memoryReport.write(opts.memoryReportPath)) {
+        std::cerr << "Failed to write " << opts.memoryReportPath << std::endl;
+    }
+
+    if (!failures.entries.empty()) {
+        std::sort(failures.entries.begin(), failures.entries.end());
+        std::cerr << failures.entries.size() << " file(s) failed" << std::endl;
+
+        if (!opts.failedLog.empty()) {
+            std::ofstream log(opts.failedLog);
+            for (const auto& entry : failures.entries) {
+                log << entry.first << "\t" << entry.second << "\n";
+            }
+            if (!log) std::cerr << "Failed to write " << opts.failedLog << std::endl;
+        }
+    }
+
+    return failures.entries.empty() ? 0 : 1;
+}
+
+// ============================================================================
+// BENCHMARKS
+// ============================================================================
+
+// Evicts a file from the page cache so the next read comes from storage.
+// Only clean pages can be dropped; returns false where unsupported.
+bool dropFileCache(const std::string& path) {
+#ifdef __linux__
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    int rc = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    return rc == 0;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+struct BenchOptions {
+    std::vector<std::string> inputs;
+    std::string scratchDir;
+    unsigned jobs = 0;
+    u32 runs = 3;
+    bool cold = true;
+    u32 scale = 4;
+};
+
+void printBenchUsage(const char* exe) {
+    std::cout << "Usage: " << exe << " bench <kind> [options] <file.bntx | directory>... -o <scratch dir>\n\n"
+              << "Kinds:\n"
+              << "  pipeline    sequential vs file-parallel vs pipelined extraction, with and\n"
+              << "              without offset-sorted planned reads, and planned under a\n"
+              << "              1 MB --memory-budget\n"
+              << "  pack        reloading all textures from BNTX (parse + untile) vs from a\n"
+              << "              rebased in-memory BNTX (pointers + untile) vs from a\n"
+              << "              texture pack (map + lookup by name) vs from an LZ4 pack\n"
+              << "              (parallel chunk decode)\n"
+              << "  decode      full decode plus box resize vs decimated decode, on textures\n"
+              << "              already in memory\n"
+              << "  pin         pipelined extraction with free-floating vs pinned, NUMA-placed\n"
+              << "              workers\n"
+              << "  isa         the decode path once per supported instruction set (see --isa),\n"
+              << "              checking that all produce the same output\n"
+              << "  io          whole-file extraction with each read strategy (ifstream, pread,\n"
+              << "              mmap, direct) and write strategy (ofstream, writev, mmap,\n"
+              << "              io_uring), on a cold and then a warm cache\n\n"
+              << "Options:\n"
+              << "  -j, --jobs <n>   Worker threads (default: all cores)\n"
+              << "  --runs <n>       Runs per variant (default: 3)\n"
+              << "  --scale <n>      Bench decode downscale: 2, 4, 8 or 16 (default: 4)\n"
+              << "  --isa <set>      Kernels to use (default: auto)\n"
+              << "  --warm           Keep inputs in the page cache (default: evict before each run)\n";
+}
+
+// Times one benchmark variant over several runs and prints best/median.
+// evict lists the files read by the variant, dropped from the cache before each
+// cold run. cleanScratch empties the scratch directory before each run.
+template <typename Fn>
+void benchVariant(const char* name, const BenchOptions& opts, const std::vector<std::string>& evict,
+                  Fn&& run, bool cleanScratch = true) {
+    std::vector<double> times;
+    u64 bytes = 0;
+    for (u32 r = 0; r < opts.runs; r++) {
+        std::error_code ec;
+        if (cleanScratch) std::filesystem::remove_all(opts.scratchDir, ec);
+        if (opts.cold) {
+            for (const auto& path : evict) dropFileCache(path);
+        }
+        resetProgress();
+
+        auto start = std::chrono::steady_clock::now();
+        run();
+        times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        bytes = progress.bytesIn;
+    }
+    std::sort(times.begin(), times.end());
+    double best = times.front(), median = times[times.size() / 2];
+    std::cout << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << best << "s" << std::setw(10) << median << "s"
+              << std::setprecision(1) << std::setw(12) << bytes / best / (1024.0 * 1024.0) << " MB/s" << std::endl;
+}
+
+// Sums a buffer so both load paths really touch every byte they hand out.
+u64 checksum(const u8* data, size_t size) {
+    u64 sum = 0;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        u64 v;
+        std::memcpy(&v, data + i, 8);
+        sum += v;
+    }
+    for (; i < size; i++) sum += data[i];
+    return sum;
+}
+
+bool buildBenchPack(const BenchOptions& opts, std::vector<BatchJob> jobs, const std::string& packPath, bool lz4) {
+    for (auto& job : jobs) job.outputDir.clear();
+    std::vector<std::unique_ptr<WorkerSlot>> slots;
+    for (unsigned i = 0; i < opts.jobs; i++) slots.push_back(std::make_unique<WorkerSlot>());
+    FailureLog failures;
+    Manifest manifest;
+    MemoryReport memoryReport;
+    MemoryBudget budget(0);
+    TexPackWriter pack;
+    if (!pack.open(packPath, lz4)) {
+        std::cerr << "Error: cannot create " << packPath << std::endl;
+        return false;
+    }
+    PipelineOptions pipeline;
+    pipeline.workers = opts.jobs;
+    pipeline.budget = &budget;
+    pipeline.pack = &pack;
+    runPipeline(jobs, pipeline, slots, failures, manifest, memoryReport);
+    return pack.finish();
+}
+
+void benchPackLoad(const BenchOptions& opts, const std::vector<BatchJob>& jobs, const std::vector<std::string>& inputs) {
+    std::error_code ec;
+    std::filesystem::create_directories(opts.scratchDir, ec);
+    std::string packPath = (std::filesystem::path(opts.scratchDir) / "bench.texpack").string();
+    std::string lz4Path = (std::filesystem::path(opts.scratchDir) / "bench-lz4.texpack").string();
+    if (!buildBenchPack(opts, jobs, packPath, false) || !buildBenchPack(opts, jobs, lz4Path, true)) return;
+
+    std::atomic<u64> sink{0};
+    benchVariant("bntx-reparse", opts, inputs, [&] {
+        for (const auto& job : jobs) {
+            FileBuffer data;
+            if (!readFile(job.inputPath, data)) continue;
+            for (const auto& tex : parseBNTX(data)) {
+                EncodedTexture enc;
+                if (!encodeTexture(tex, enc)) continue;
+                sink += checksum(enc.payload.data(), enc.payload.size());
+                progress.bytesIn.fetch_add(enc.payload.size(), std::memory_order_relaxed);
+            }
+        }
+    }, false);
+
+    // The same work with each file rebased in memory and its textures reached
+    // through pointers instead of parsed. Files not in host byte order are skipped.
+    benchVariant("bntx-rebased", opts, inputs, [&] {
+        for (const auto& job : jobs) {
+            FileBuffer data;
+            BNTXImage image;
+            std::string error;
+            if (!readFile(job.inputPath, data) || !image.load(std::move(data), error)) continue;
+            for (u32 i = 0; i < image.textureCount(); i++) {
+                BRTIView<HostOrder> brti = image.texture(i);
+                BNTXTexture tex;
+                tex.name = BNTXImage::name(brti);
+                readTextureInfo(brti, tex);
+                const u8* texData = BNTXImage::data(brti);
+                tex.data.assign(texData, texData + tex.imageSize);
+                EncodedTexture enc;
+                if (!encodeTexture(tex, enc)) continue;
+                sink += checksum(enc.payload.data(), enc.payload.size());
+                progress.bytesIn.fetch_add(enc.payload.size(), std::memory_order_relaxed);
+            }
+        }
+    }, false);
+
+    benchVariant("texpack-map", opts, {packPath}, [&] {
+        texpack::TexPackReader reader;
+        if (!reader.open(packPath.c_str())) return;
+        for (u32 i = 0; i < reader.count(); i++) {
+            const texpack::TexPackEntry* e = reader.find(reader.name(reader.entry(i)));
+            sink += checksum(reader.data(*e), reader.dataSize(*e));
+            progress.bytesIn.fetch_add(reader.dataSize(*e), std::memory_order_relaxed);
+        }
+    }, false);
+
+    // Every worker takes chunks round-robin across all textures.
+    benchVariant("texpack-lz4", opts, {lz4Path}, [&] {
+        texpack::TexPackReader reader;
+        if (!reader.open(lz4Path.c_str())) return;
+        std::vector<std::pair<const texpack::TexPackEntry*, u32>> chunks;
+        for (u32 i = 0; i < reader.count(); i++) {
+            const texpack::TexPackEntry* e = reader.find(reader.name(reader.entry(i)));
+            for (u32 c = 0; c < reader.chunkCount(*e); c++) chunks.emplace_back(e, c);
+        }
+        std::atomic<size_t> next{0};
+        std::vector<std::thread> workers;
+        for (unsigned w = 0; w < opts.jobs; w++) {
+            workers.emplace_back([&] {
+                SurfaceBuffer chunk(PACK_CHUNK_SIZE);
+                for (size_t k; (k = next.fetch_add(1)) < chunks.size();) {
+                    const texpack::TexPackEntry& e = *chunks[k].first;
+                    u32 c = chunks[k].second;
+                    size_t raw = std::min<size_t>(PACK_CHUNK_SIZE, reader.dataSize(e) - (size_t)c * PACK_CHUNK_SIZE);
+                    if (!reader.readChunk(e, 0, c, chunk.data())) continue;
+                    sink += checksum(chunk.data(), raw);
+                    progress.bytesIn.fetch_add(raw, std::memory_order_relaxed);
+                }
+            });
+        }
+        for (auto& t : workers) t.join();
+    }, false);
+
+    u64 inputBytes = 0;
+    for (const auto& path : inputs) inputBytes += std::filesystem::file_size(path, ec);
+    std::cout << "sizes: bntx " << formatMB(inputBytes) << ", texpack "
+              << formatMB(std::filesystem::file_size(packPath, ec)) << ", texpack-lz4 "
+              << formatMB(std::filesystem::file_size(lz4Path, ec)) << std::endl;
+
+    if (sink == 42) std::cout << std::endl;
+}
+
+// Box-filters an RGBA8 image down by scale, the resize a full decode needs.
+SurfaceBuffer downsampleBox(const SurfaceBuffer& rgba, u32 width, u32 height, u32 scale) {
+    u32 outWidth = DIV_ROUND_UP(width, scale), outHeight = DIV_ROUND_UP(height, scale);
+    SurfaceBuffer out((size_t)outWidth * outHeight * 4);
+    for (u32 y = 0; y < outHeight; y++) {
+        for (u32 x = 0; x < outWidth; x++) {
+            u32 sum[4] = {}, n = 0;
+            for (u32 sy = y * scale; sy < std::min(height, (y + 1) * scale); sy++) {
+                for (u32 sx = x * scale; sx < std::min(width, (x + 1) * scale); sx++, n++) {
+                    for (int c = 0; c < 4; c++) sum[c] += rgba[((size_t)sy * width + sx) * 4 + c];
+                }
+            }
+            for (int c = 0; c < 4; c++) out[((size_t)y * outWidth + x) * 4 + c] = (u8)((sum[c] + n / 2) / n);
+        }
+    }
+    return out;
+}
+
+// Decodable textures untiled into memory, for benchmarks of the decode path.
+struct BenchSurface {
+    BNTXTexture tex;
+    SurfaceBuffer untiled;
+};
+
+std::vector<BenchSurface> loadBenchSurfaces(const std::vector<BatchJob>& jobs) {
+    std::vector<BenchSurface> surfaces;
+    for (const auto& job : jobs) {
+        FileBuffer data;
+        if (!readFile(job.inputPath, data)) continue;
+        for (auto& tex : parseBNTX(data)) {
+            EncodedTexture enc;
+            if (!canDecode(tex.format >> 8) || !encodeTexture(tex, enc)) continue;
+            tex.data = TextureBuffer();
+            surfaces.push_back({tex, std::move(enc.payload)});
+        }
+    }
+    return surfaces;
+}
+
+// Runs convert over every surface on opts.jobs threads and returns the sum
+// of the output checksums, which does not depend on the order.
+template <typename Fn>
+u64 convertSurfaces(const BenchOptions& opts, const std::vector<BenchSurface>& surfaces, Fn&& convert) {
+    std::atomic<u64> sink{0};
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < opts.jobs; w++) {
+        workers.emplace_back([&] {
+            for (size_t k; (k = next.fetch_add(1)) < surfaces.size();) {
+                SurfaceBuffer preview = convert(surfaces[k]);
+                sink += checksum(preview.data(), preview.size());
+                progress.bytesIn.fetch_add(surfaces[k].untiled.size(), std::memory_order_relaxed);
+            }
+        });
+    }
+    for (auto& t : workers) t.join();
+    return sink;
+}
+
+// Untiles every decodable texture once, then times turning them into previews.
+void benchDecode(const BenchOptions& opts, const std::vector<BatchJob>& jobs) {
+    std::vector<BenchSurface> surfaces = loadBenchSurfaces(jobs);
+    std::atomic<u64> sink{0};
+    auto runAll = [&](auto&& convert) { sink += convertSurfaces(opts, surfaces, convert); };
+
+    benchVariant("decode+resize", opts, {}, [&] {
+        runAll([&](const BenchSurface& s) {
+            SurfaceBuffer rgba;
+            decodeSurface(s.tex.format, s.tex.compSel, s.tex.width, s.tex.height, s.untiled, rgba);
+            return downsampleBox(rgba, s.tex.width, s.tex.height, opts.scale);
+        });
+    }, false);
+
+    benchVariant("decimated", opts, {}, [&] {
+        runAll([&](const BenchSurface& s) {
+            SurfaceDecode params;
+            params.scale = opts.scale;
+            SurfaceBuffer rgba;
+            decodeSurface(s.tex.format, s.tex.compSel, s.tex.width, s.tex.height, s.untiled, rgba, params);
+            return rgba;
+        });
+    }, false);
+
+    if (sink == 42) std::cout << std::endl;
+}
+
+// The decode path (selectors, normal Z, statistics, solid check and mip
+// generation) once per instruction set this CPU supports. Every set must
+// produce the scalar output bit for bit.
+void benchIsa(const BenchOptions& opts, const std::vector<BatchJob>& jobs) {
+    std::vector<BenchSurface> surfaces = loadBenchSurfaces(jobs);
+    auto convert = [](const BenchSurface& s) {
+        TextureStats stats;
+        SurfaceDecode params;
+        params.normal = NORMAL_RGBA;
+        params.stats = &stats;
+        SurfaceBuffer rgba;
+        if (!decodeSurface(s.tex.format, s.tex.compSel, s.tex.width, s.tex.height, s.untiled, rgba, params)) return rgba;
+        generateMips(rgba, s.tex.width, s.tex.height, 4, false);
+        u64 digest[8] = {stats.opaque, stats.transparent, (u64)Read32LE(stats.min) << 32 | Read32LE(stats.max),
+                         stats.sum[0], stats.sum[1], stats.sum[2], stats.sum[3],
+                         allBlocksEqual(s.untiled.data(), s.untiled.size(), 8)};
+        const u8* bytes = reinterpret_cast<const u8*>(digest);
+        rgba.insert(rgba.end(), bytes, bytes + sizeof(digest));
+        return rgba;
+    };
+
+    Isa original = activeIsa;
+    u64 reference = 0;
+    for (int isa = 0; isa < ISA_COUNT; isa++) {
+        if (!useIsa((Isa)isa)) continue;
+        u64 sum = 0;
+        benchVariant(ISA_NAMES[isa], opts, {}, [&] { sum = convertSurfaces(opts, surfaces, convert); }, false);
+        if (isa == ISA_SCALAR) reference = sum;
+        else if (sum != reference) std::cerr << "Warning: " << ISA_NAMES[isa] << " output differs from scalar" << std::endl;
+    }
+    useIsa(original);
+}
+
+void benchPinning(const BenchOptions& opts, const std::vector<BatchJob>& jobs, const std::vector<std::string>& inputs) {
+    CpuTopology topology = discoverTopology();
+    std::vector<std::unique_ptr<WorkerSlot>> slots;
+    for (unsigned i = 0; i < opts.jobs; i++) slots.push_back(std::make_unique<WorkerSlot>());
+    FailureLog failures;
+    Manifest manifest;
+    MemoryReport memoryReport;
+    MemoryBudget budget(0);
+    PipelineOptions pipeline;
+    pipeline.workers = opts.jobs;
+    pipeline.budget = &budget;
+    benchVariant("unpinned", opts, inputs, [&] {
+        runPipeline(jobs, pipeline, slots, failures, manifest, memoryReport);
+    });
+    PipelineOptions pinned = pipeline;
+    pinned.topology = &topology;
+    benchVariant("pinned", opts, inputs, [&] {
+        runPipeline(jobs, pinned, slots, failures, manifest, memoryReport);
+    });
+}
+
+// The whole-file pipeline once per read strategy (writing with ofstream) and
+// once per write strategy (reading with ifstream). Cold runs evict the inputs
+// first and include syncing the outputs, so writeback is part of the time;
+// warm runs do neither.
+void benchIo(const BenchOptions& opts, const std::vector<BatchJob>& jobs, const std::vector<std::string>& inputs) {
+    std::vector<std::unique_ptr<WorkerSlot>> slots;
+    for (unsigned i = 0; i < opts.jobs; i++) slots.push_back(std::make_unique<WorkerSlot>());
+    FailureLog failures;
+    Manifest manifest;
+    MemoryReport memoryReport;
+    MemoryBudget budget(0);
+    PipelineOptions pipeline;
+    pipeline.workers = opts.jobs;
+    pipeline.budget = &budget;
+    pipeline.planIO = false;
+
+    IoOptions saved = ioOptions;
+    auto runWith = [&](const BenchOptions& cache, IoOptions io, const std::string& name) {
+        if (!ioStrategySupported(io.read, io.write)) {
+            std::cout << std::left << std::setw(16) << name << std::right << "   unavailable here" << std::endl;
+            return;
+        }
+        ioOptions = io;
+        benchVariant(name.c_str(), cache, inputs, [&] {
+            runPipeline(jobs, pipeline, slots, failures, manifest, memoryReport);
+#ifndef _WIN32
+            if (cache.cold) sync();
+#endif
+        });
+    };
+
+    for (bool cold : {true, false}) {
+        if (cold && !opts.cold) continue;
+        BenchOptions cache = opts;
+        cache.cold = cold;
+        std::cout << (cold ? "cold cache:" : "warm cache:") << std::endl;
+        for (int r = 0; r < READ_STRATEGY_COUNT; r++) {
+            runWith(cache, {(ReadStrategy)r, WRITE_OFSTREAM}, std::string("read-") + READ_STRATEGY_NAMES[r]);
+        }
+        for (int w = 0; w < WRITE_STRATEGY_COUNT; w++) {
+            runWith(cache, {READ_IFSTREAM, (WriteStrategy)w}, std::string("write-") + WRITE_STRATEGY_NAMES[w]);
+        }
+    }
+    ioOptions = saved;
+}
+
+int runBench(int argc, char** argv, const char* exe) {
+    if (argc < 2) {
+        printBenchUsage(exe);
+        return 1;
+    }
+    std::string kind = argv[1];
+    BenchOptions opts;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if ((arg == "-o" || arg == "--output") && hasValue) {
+            opts.scratchDir = argv[++i];
+        } else if ((arg == "-j" || arg == "--jobs") && hasValue) {
+            if (!parseOption(arg, argv[++i], opts.jobs)) return 1;
+        } else if (arg == "--runs" && hasValue) {
+            if (!parseOption(arg, argv[++i], opts.runs)) return 1;
+            opts.runs = std::max(1u, opts.runs);
+        } else if (arg == "--scale" && hasValue) {
+            if (!parseOption(arg, argv[++i], opts.scale)) return 1;
+            if (opts.scale < 2 || opts.scale > 16 || (opts.scale & (opts.scale - 1))) {
+                std::cerr << "Error: --scale expects 2, 4, 8 or 16" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--isa" && hasValue) {
+            if (!selectIsa(argv[++i])) return 1;
+        } else if (arg == "--warm") {
+            opts.cold = false;
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Error: unknown option " << arg << std::endl;
+            printBenchUsage(exe);
+            return 1;
+        } else {
+            opts.inputs.push_back(arg);
+        }
+    }
+    if (opts.inputs.empty() || opts.scratchDir.empty()) {
+        printBenchUsage(exe);
+        return 1;
+    }
+    if (opts.jobs == 0) opts.jobs = std::max(1u, std::thread::hardware_concurrency());
+    verbose = false;
+
+    // Runs clear their scratch directory, so it is a fresh subdirectory of -o
+    // rather than -o itself, which may hold the user's files.
+    std::error_code ec;
+    std::filesystem::path scratchParent(opts.scratchDir);
+    std::filesystem::create_directories(scratchParent, ec);
+    std::filesystem::path scratch;
+    for (u32 n = 0;; n++) {
+        scratch = scratchParent / ("bench-scratch-" + std::to_string(n));
+        if (std::filesystem::create_directory(scratch, ec)) break;
+        if (ec || n == 9999) {
+            std::cerr << "Error: cannot create a scratch directory in " << opts.scratchDir << std::endl;
+            return 1;
+        }
+    }
+    opts.scratchDir = scratch.string();
+
+    BatchOptions batch;
+    batch.inputs = opts.inputs;
+    batch.outputDir = opts.scratchDir;
+    std::vector<BatchJob> jobs = collectJobs(batch);
+    if (jobs.empty()) {
+        std::cerr << "Error: no .bntx files found" << std::endl;
+        std::filesystem::remove_all(opts.scratchDir, ec);
+        return 1;
+    }
+
+    if (opts.cold && !dropFileCache(jobs[0].inputPath)) {
+        std::cerr << "Warning: cannot evict files from the page cache here, results are warm-cache" << std::endl;
+        opts.cold = false;
+    }
+
+    std::cout << jobs.size() << " files, " << opts.jobs << " threads, " << opts.runs << " runs, "
+              << (opts.cold ? "cold" : "warm") << " cache, " << ISA_NAMES[activeIsa] << " kernels\n";
+    if (kind == "pin") {
+        CpuTopology topology = discoverTopology();
+        std::cout << "CPUs per NUMA node:";
+        for (const auto& cpus : topology.nodes) std::cout << ' ' << cpus.size();
+        std::cout << '\n';
+    }
+    std::cout << std::left << std::setw(16) << "variant" << std::right << std::setw(11) << "best"
+              << std::setw(11) << "median" << std::setw(17) << "input rate" << std::endl;
+
+    std::vector<std::string> inputs;
+    for (const auto& job : jobs) inputs.push_back(job.inputPath);
+
+    if (kind == "pipeline") {
+        std::vector<std::unique_ptr<WorkerSlot>> slots;
+        for (unsigned i = 0; i < opts.jobs; i++) slots.push_back(std::make_unique<WorkerSlot>());
+        FailureLog failures;
+        Manifest manifest;
+        MemoryReport memoryReport;
+
+        benchVariant("sequential", opts, inputs, [&] {
+            runThreadWorkers(jobs, 1, slots, failures, manifest, memoryReport);
+        });
+        benchVariant("file-parallel", opts, inputs, [&] {
+            runThreadWorkers(jobs, opts.jobs, slots, failures, manifest, memoryReport);
+        });
+        MemoryBudget budget(0);
+        PipelineOptions pipeline;
+        pipeline.workers = opts.jobs;
+        pipeline.budget = &budget;
+        pipeline.planIO = false;
+        benchVariant("pipeline", opts, inputs, [&] {
+            runPipeline(jobs, pipeline, slots, failures, manifest, memoryReport);
+        });
+        PipelineOptions planned = pipeline;
+        planned.planIO = true;
+        benchVariant("pipeline+plan", opts, inputs, [&] {
+            runPipeline(jobs, planned, slots, failures, manifest, memoryReport);
+        });
+        // A budget smaller than any coalesced run: the planned reader must
+        // still make progress, one run at a time.
+        MemoryBudget tiny(1024 * 1024);
+        PipelineOptions budgeted = planned;
+        budgeted.budget = &tiny;
+        benchVariant("plan+1MB-budget", opts, inputs, [&] {
+            runPipeline(jobs, budgeted, slots, failures, manifest, memoryReport);
+        });
+    } else if (kind == "pack") {
+        benchPackLoad(opts, jobs, inputs);
+    } else if (kind == "decode") {
+        benchDecode(opts, jobs);
+    } else if (kind == "pin") {
+        benchPinning(opts, jobs, inputs);
+    } else if (kind == "isa") {
+        benchIsa(opts, jobs);
+    } else if (kind == "io") {
+        benchIo(opts, jobs, inputs);
+    } else {
+        std::cerr << "Error: unknown benchmark " << kind << std::endl;
+        printBenchUsage(exe);
+        std::filesystem::remove_all(opts.scratchDir, ec);
+        return 1;
+    }
+
+    std::filesystem::remove_all(opts.scratchDir, ec);
+    return 0;
+}
+
+// Combines per-shard manifests. Rows are deduplicated so re-running a shard
+// and merging again is harmless.
+int runMerge(int argc, char** argv) {
+    std::string outPath;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+            outPath = argv[++i];
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+    if (outPath.empty() || inputs.empty()) {
+        std::cerr << "Usage: merge -o <merged.tsv> <manifest.tsv>..." << std::endl;
+        return 1;
+    }
+
+    Manifest merged;
+    for (const auto& path : inputs) {
+        std::string error;
+        if (!merged.read(path, error)) {
+            std::cerr << path << ": " << error << std::endl;
+            return 1;
+        }
+    }
+
+    std::sort(merged.entries.begin(), merged.entries.end());
+    size_t before = merged.entries.size();
+    merged.entries.erase(std::unique(merged.entries.begin(), merged.entries.end(),
+                                     [](const ManifestEntry& a, const ManifestEntry& b) {
+                                         return a.toLine() == b.toLine();
+                                     }),
+                         merged.entries.end());
+
+    if (!merged.write(outPath)) {
+        std::cerr << "Failed to write " << outPath << std::endl;
+        return 1;
+    }
+    std::cout << "Merged " << inputs.size() << " manifests: " << merged.entries.size() << " textures";
+    if (before != merged.entries.size()) std::cout << " (" << before - merged.entries.size() << " duplicates dropped)";
+    std::cout << std::endl;
+    return 0;
+}
+
+// ============================================================================
+// CONTACT SHEETS
+// ============================================================================
+
+// PNG with stored (uncompressed) deflate blocks: no zlib needed, and sheets are
+// looked at, not archived.
+u32 crc32(const u8* data, size_t size, u32 crc = 0) {
+    static const std::vector<u32> table = [] {
+        std::vector<u32> t(256);
+        for (u32 i = 0; i < 256; i++) {
+            u32 c = i;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void writePNGChunk(std::ofstream& out, const char* type, const std::vector<u8>& data) {
+    std::vector<u8> chunk(type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    u8 length[4] = {(u8)(data.size() >> 24), (u8)(data.size() >> 16), (u8)(data.size() >> 8), (u8)data.size()};
+    u32 crc = crc32(chunk.data(), chunk.size());
+    u8 crcBytes[4] = {(u8)(crc >> 24), (u8)(crc >> 16), (u8)(crc >> 8), (u8)crc};
+    out.write(reinterpret_cast<const char*>(length), 4);
+    out.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+    out.write(reinterpret_cast<const char*>(crcBytes), 4);
+}
+
+// Writes width x height RGB8 pixels.
+bool writePNG(const std::string& path, u32 width, u32 height, const std::vector<u8>& rgb) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+    out.write("\x89PNG\r\n\x1a\n", 8);
+
+    // IHDR: size, 8-bit RGB, deflate, no filter, no interlace
+    std::vector<u8> ihdr = {(u8)(width >> 24), (u8)(width >> 16), (u8)(width >> 8), (u8)width,
+                            (u8)(height >> 24), (u8)(height >> 16), (u8)(height >> 8), (u8)height,
+                            8, 2, 0, 0, 0};
+    writePNGChunk(out, "IHDR", ihdr);
+
+    // Scanlines with filter type 0, wrapped in stored deflate blocks of up to 64 KiB.
+    std::vector<u8> raw;
+    raw.reserve((size_t)(width * 3 + 1) * height);
+    for (u32 y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb.begin() + (size_t)y * width * 3, rgb.begin() + (size_t)(y + 1) * width * 3);
+    }
+    std::vector<u8> z = {0x78, 0x01};
+    for (size_t pos = 0; pos < raw.size() || pos == 0; ) {
+        size_t n = std::min<size_t>(65535, raw.size() - pos);
+        bool last = pos + n == raw.size();
+        u8 block[5] = {(u8)last, (u8)n, (u8)(n >> 8), (u8)~n, (u8)(~n >> 8)};
+        z.insert(z.end(), block, block + 5);
+        z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + n);
+        pos += n;
+        if (last) break;
+    }
+    u32 a = 1, b = 0;
+    for (u8 c : raw) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    u32 adler = (b << 16) | a;
+    u8 adlerBytes[4] = {(u8)(adler >> 24), (u8)(adler >> 16), (u8)(adler >> 8), (u8)adler};
+    z.insert(z.end(), adlerBytes, adlerBytes + 4);
+    writePNGChunk(out, "IDAT", z);
+    writePNGChunk(out, "IEND", {});
+    return (bool)out;
+}
+
+// 5x7 label font, one byte per row, bit 4 leftmost. Lowercase is drawn as
+// uppercase; anything else missing as '?'.
+const char FONT_CHARS[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ-_.?/:";
+const u8 FONT_GLYPHS[][7] = {
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}, {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E},
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}, {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E},
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}, {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E},
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}, {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08},
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}, {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C},
+    {0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11}, {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E},
+    {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}, {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C},
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}, {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10},
+    {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F}, {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11},
+    {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}, {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C},
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}, {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F},
+    {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}, {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11},
+    {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10},
+    {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D}, {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11},
+    {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E}, {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04},
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04},
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A}, {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11},
+    {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04}, {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F},
+    {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F},
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}, {0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04},
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}, {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00},
+};
+const u32 GLYPH_ADVANCE = 6;
+const u32 LABEL_LINE = 9;
+
+struct SheetOptions {
+    std::vector<std::string> inputs;
+    std::string outputDir;
+    unsigned jobs = 0;
+    u32 thumbSize = 128;
+    u32 columns = 0;    // 0: as close to square as the count allows
+};
+
+// One cell of a sheet: an RGBA thumbnail no larger than thumbSize on either
+// side, or none if the format cannot be previewed.
+struct Thumbnail {
+    std::string name;
+    std::string info;
+    u32 width = 0;
+    u32 height = 0;
+    std::vector<u8> rgba;
+};
+
+// Decodes tex at the coarsest power-of-two scale that still covers the
+// thumbnail, then point-samples it to fit. Solid textures in formats without
+// a decoder still get their color; other BC6H/BC7/ASTC textures get no preview.
+Thumbnail makeThumbnail(const BNTXTexture& tex, u32 thumbSize) {
+    Thumbnail thumb;
+    thumb.name = tex.name;
+    u32 formatType = tex.format >> 8;
+    auto fmtIt = formats.find(formatType);
+    thumb.info = std::to_string(tex.width) + "x" + std::to_string(tex.height) + " " +
+                 (fmtIt != formats.end() ? fmtIt->second : "?");
+
+    u32 blkWidth, blkHeight, bpp;
+    if (!formatInfo(formatType, blkWidth, blkHeight, bpp) || tex.width == 0 || tex.height == 0) return thumb;
+    SurfaceBuffer surface = deswizzle(tex.width, tex.height, blkWidth, blkHeight, bpp, tex.tileMode,
+                                      tex.alignment, tex.sizeRange, tex.data);
+
+    u32 longest = std::max(tex.width, tex.height);
+    u32 scale = 1;
+    while (scale < 16 && DIV_ROUND_UP(longest, scale * 2) >= thumbSize) scale *= 2;
+    u32 srcWidth = DIV_ROUND_UP(tex.width, scale), srcHeight = DIV_ROUND_UP(tex.height, scale);
+
+    SurfaceBuffer rgba;
+    SurfaceDecode params;
+    params.scale = scale;
+    if (!decodeSurface(tex.format, tex.compSel, tex.width, tex.height, surface, rgba, params)) {
+        u8 color[4];
+        if (classifySurface(tex.format, tex.compSel, tex.width, tex.height, surface, color) == CONTENT_VARIED) return thumb;
+        srcWidth = srcHeight = 1;
+        rgba.assign(color, color + 4);
+    }
+
+    u32 srcLongest = std::max(srcWidth, srcHeight);
+    thumb.width = longest == tex.width ? thumbSize : std::max(1u, (u32)((u64)tex.width * thumbSize / longest));
+    thumb.height = longest == tex.height ? thumbSize : std::max(1u, (u32)((u64)tex.height * thumbSize / longest));
+    if (srcLongest < thumbSize && srcWidth > 1 && srcHeight > 1) {
+        // Small textures are shown at their own size rather than blown up.
+        thumb.width = srcWidth;
+        thumb.height = srcHeight;
+    }
+    thumb.rgba.resize((size_t)thumb.width * thumb.height * 4);
+    for (u32 y = 0; y < thumb.height; y++) {
+        u32 sy = (u32)(((u64)y * 2 + 1) * srcHeight / (thumb.height * 2));
+        for (u32 x = 0; x < thumb.width; x++) {
+            u32 sx = (u32)(((u64)x * 2 + 1) * srcWidth / (thumb.width * 2));
+            std::memcpy(&thumb.rgba[((size_t)y * thumb.width + x) * 4], &rgba[((size_t)sy * srcWidth + sx) * 4], 4);
+        }
+    }
+    return thumb;
+}
+
+class SheetCanvas {
+public:
+    SheetCanvas(u32 width, u32 height) : width(width), height(height), rgb((size_t)width * height * 3, 0x20) {}
+
+    void fill(u32 x0, u32 y0, u32 w, u32 h, u8 r, u8 g, u8 b) {
+        for (u32 y = y0; y < std::min(height, y0 + h); y++) {
+            for (u32 x = x0; x < std::min(width, x0 + w); x++) {
+                u8* px = &rgb[((size_t)y * width + x) * 3];
+                px[0] = r; px[1] = g; px[2] = b;
+            }
+        }
+    }
+
+    // Blends a thumbnail over a checkerboard so alpha stays visible.
+    void blit(u32 x0, u32 y0, const Thumbnail& thumb) {
+        for (u32 y = 0; y < thumb.height; y++) {
+            for (u32 x = 0; x < thumb.width; x++) {
+                const u8* src = &thumb.rgba[((size_t)y * thumb.width + x) * 4];
+                u8* dst = &rgb[((size_t)(y0 + y) * width + x0 + x) * 3];
+                u32 check = ((x / 8) ^ (y / 8)) & 1 ? 0x99 : 0x66;
+                for (int c = 0; c < 3; c++) dst[c] = (u8)((src[c] * src[3] + check * (255 - src[3]) + 127) / 255);
+            }
+        }
+    }
+
+    void text(u32 x0, u32 y0, const std::string& s, u32 maxWidth) {
+        size_t maxChars = maxWidth / GLYPH_ADVANCE;
+        std::string shown = s.size() > maxChars && maxChars > 2 ? s.substr(0, maxChars - 2) + ".." : s;
+        for (size_t i = 0; i < shown.size() && i < maxChars; i++) {
+            char ch = (char)std::toupper((unsigned char)shown[i]);
+            if (ch == ' ') continue;
+            const char* found = std::strchr(FONT_CHARS, ch);
+            const u8* glyph = FONT_GLYPHS[found && ch ? found - FONT_CHARS : std::strchr(FONT_CHARS, '?') - FONT_CHARS];
+            for (u32 y = 0; y < 7; y++) {
+                for (u32 x = 0; x < 5; x++) {
+                    if (glyph[y] & (0x10 >> x)) fill(x0 + (u32)i * GLYPH_ADVANCE + x, y0 + y, 1, 1, 0xE0, 0xE0, 0xE0);
+                }
+            }
+        }
+    }
+
+    bool save(const std::string& path) const { return writePNG(path, width, height, rgb); }
+
+private:
+    u32 width, height;
+    std::vector<u8> rgb;
+};
+
+// Thumbnails every texture of one file in parallel and lays them out in a
+// labelled grid.
+bool buildSheet(const std::vector<BNTXTexture>& textures, const SheetOptions& opts, const std::string& path) {
+    std::vector<Thumbnail> thumbs(textures.size());
+    std::atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t i; (i = next.fetch_add(1)) < textures.size();) thumbs[i] = makeThumbnail(textures[i], opts.thumbSize);
+    };
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < std::min<size_t>(opts.jobs, textures.size()); t++) threads.emplace_back(work);
+    work();
+    for (auto& t : threads) t.join();
+
+    const u32 pad = 6;
+    u32 columns = opts.columns ? opts.columns : (u32)std::ceil(std::sqrt((double)thumbs.size()));
+    columns = std::max(1u, std::min(columns, (u32)thumbs.size()));
+    u32 rows = (u32)DIV_ROUND_UP(thumbs.size(), columns);
+    u32 cellWidth = std::max(opts.thumbSize, 16 * GLYPH_ADVANCE) + pad;
+    u32 cellHeight = opts.thumbSize + 2 * LABEL_LINE + pad;
+
+    SheetCanvas canvas(columns * cellWidth + pad, rows * cellHeight + pad);
+    for (size_t i = 0; i < thumbs.size(); i++) {
+        u32 x = pad + (u32)(i % columns) * cellWidth;
+        u32 y = pad + (u32)(i / columns) * cellHeight;
+        const Thumbnail& thumb = thumbs[i];
+        if (thumb.rgba.empty()) {
+            canvas.fill(x, y, opts.thumbSize, opts.thumbSize, 0x40, 0x40, 0x40);
+            canvas.text(x + 4, y + opts.thumbSize / 2 - 3, "NO PREVIEW", opts.thumbSize - 8);
+        } else {
+            canvas.blit(x, y, thumb);
+        }
+        canvas.text(x, y + opts.thumbSize + 2, thumb.name, cellWidth - pad);
+        canvas.text(x, y + opts.thumbSize + 2 + LABEL_LINE, thumb.info, cellWidth - pad);
+    }
+    return canvas.save(path);
+}
+
+int runSheet(int argc, char** argv) {
+    SheetOptions opts;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if ((arg == "-o" || arg == "--output") && hasValue) {
+            opts.outputDir = argv[++i];
+        } else if ((arg == "-j" || arg == "--jobs") && hasValue) {
+            if (!parseOption(arg, argv[++i], opts.jobs)) return 1;
+        } else if (arg == "--thumb" && hasValue) {
+            if (!parseOption(arg, argv[++i], opts.thumbSize)) return 1;
+            opts.thumbSize = std::min(1024u, std::max(16u, opts.thumbSize));
+        } else if (arg == "--columns" && hasValue) {
+            if (!parseOption(arg, argv[++i], opts.columns)) return 1;
+        } else if (arg == "--isa" && hasValue) {
+            if (!selectIsa(argv[++i])) return 1;
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Error: unknown option " << arg << std::endl;
+            opts.inputs.clear();
+            break;
+        } else {
+            opts.inputs.push_back(arg);
+        }
+    }
+    if (opts.inputs.empty() || opts.outputDir.empty()) {
+        std::cerr << "Usage: sheet [--thumb <px>] [--columns <n>] [-j <n>] <file.bntx | directory>... -o <dir>" << std::endl;
+        return 1;
+    }
+    if (opts.jobs == 0) opts.jobs = std::max(1u, std::thread::hardware_concurrency());
+    verbose = false;
+
+    BatchOptions batch;
+    batch.inputs = opts.inputs;
+    std::vector<BatchJob> jobs = collectJobs(batch);
+    if (jobs.empty()) {
+        std::cerr << "Error: no .bntx files found" << std::endl;
+        return 1;
+    }
+
+    // One sheet per input, named after its path relative to the input directory.
+    auto start = std::chrono::steady_clock::now();
+    size_t sheets = 0, textureCount = 0;
+    for (const auto& job : jobs) {
+        std::string rel = job.packPrefix.empty() ? std::filesystem::path(job.inputPath).stem().string()
+                                                 : job.packPrefix.substr(0, job.packPrefix.size() - 1);
+        std::filesystem::path sheetPath = std::filesystem::path(opts.outputDir) / (rel + ".png");
+        std::error_code ec;
+        std::filesystem::create_directories(sheetPath.parent_path(), ec);
+
+        FileBuffer fileData;
+        std::vector<BNTXTexture> textures;
+        if (readFile(job.inputPath, fileData)) textures = parseBNTX(fileData);
+        if (textures.empty()) {
+            std::cerr << job.inputPath << ": no textures found" << std::endl;
+            continue;
+        }
+        if (!buildSheet(textures, opts, sheetPath.string())) {
+            std::cerr << "Failed to write " << sheetPath.string() << std::endl;
+            continue;
+        }
+        sheets++;
+        textureCount += textures.size();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << sheets << " sheets, " << textureCount << " textures in " << std::fixed << std::setprecision(1)
+              << seconds << "s" << std::endl;
+    return sheets == jobs.size() ? 0 : 1;
+}
+
+// ============================================================================
+// VALIDATION
+// ============================================================================
+
+// What `validate` found in one file. corrupt means extraction would fail or
+// produce wrong data; unsupported means it is well-formed but holds a format
+// there is no untiler for.
+enum ValidateStatus { VALID_OK, VALID_UNSUPPORTED, VALID_CORRUPT };
+const char* VALIDATE_STATUS_NAMES[] = {"ok", "unsupported", "corrupt"};
+
+struct ValidateResult {
+    ValidateStatus status = VALID_OK;
+    std::string detail;     // the first problem of the worst kind
+    u32 textures = 0;
+};
+
+void reportProblem(ValidateResult& result, ValidateStatus status, const std::string& detail) {
+    if (status <= result.status) return;
+    result.status = status;
+    result.detail = detail;
+}
+
+// The parser's checks, reporting instead of skipping, plus the ones it leaves
+// to the untiler: the relocation table, the format and imageSize against the
+// surface the format and layout need. Texture data is never touched.
+template <typename Order>
+void validateStructures(const u8* data, u64 size, ValidateResult& result) {
+    BNTXHeaderView<Order> header;
+    if (!header.bind(data, size, 0)) {
+        reportProblem(result, VALID_CORRUPT, "file too small");
+        return;
+    }
+    if (header.fileSize() > size) {
+        std::ostringstream msg;
+        msg << "truncated: header gives " << header.fileSize() << " bytes, file has " << size;
+        reportProblem(result, VALID_CORRUPT, msg.str());
+        return;
+    }
+
+    NXView<Order> nx;
+    if (!nx.bind(data, size, 0x20) || !nx.magicIs("NX  ")) {
+        reportProblem(result, VALID_CORRUPT, "invalid NX header");
+        return;
+    }
+
+    if (header.relocAddr() != 0) {
+        Relocations relocs;
+        std::string error;
+        if (!readRelocations(data, size, relocs, error)) {
+            reportProblem(result, VALID_CORRUPT, error);
+            return;
+        }
+        size_t bad = findBadPointer(data, size, relocs);
+        if (bad != relocs.fields.size()) {
+            std::ostringstream msg;
+            msg << "pointer at 0x" << std::hex << relocs.fields[bad] << " out of range";
+            reportProblem(result, VALID_CORRUPT, msg.str());
+            return;
+        }
+    }
+
+    for (u32 i = 0; i < nx.textureCount(); i++) {
+        std::string where = "texture " + std::to_string(i);
+        StructView<Order, 8> infoPtr;
+        BRTIView<Order> brti;
+        if (!infoPtr.bind(data, size, nx.infoPtrsAddr() + (i64)i * 8)) {
+            reportProblem(result, VALID_CORRUPT, "texture info pointers out of range");
+            return;
+        }
+        if (!brti.bind(data, size, infoPtr.ptrAt(0)) || !brti.magicIs("BRTI")) {
+            reportProblem(result, VALID_CORRUPT, where + ": invalid BRTI");
+            continue;
+        }
+
+        StringEntryView<Order> nameEntry;
+        StructView<Order, 8> mipPtrs;
+        std::string_view name;
+        if (!nameEntry.bind(data, size, brti.nameAddr()) || !nameEntry.name(data, size, name) ||
+            !mipPtrs.bind(data, size, brti.mipPtrsAddr())) {
+            reportProblem(result, VALID_CORRUPT, where + ": invalid name or mip pointer");
+            continue;
+        }
+        where = "'" + std::string(name.substr(0, name.find('\0'))) + "'";
+
+        i64 dataAddr = mipPtrs.ptrAt(0);
+        if (dataAddr < 0 || (u64)dataAddr + brti.imageSize() > size) {
+            reportProblem(result, VALID_CORRUPT, where + ": data out of range");
+            continue;
+        }
+        if (brti.width() == 0 || brti.height() == 0 || brti.sizeRange() > 5) {
+            reportProblem(result, VALID_CORRUPT, where + ": invalid dimensions or block height");
+            continue;
+        }
+
+        u32 blkWidth, blkHeight, bpp;
+        if (!formatInfo(brti.format() >> 8, blkWidth, blkHeight, bpp)) {
+            std::ostringstream msg;
+            msg << where << ": unsupported format 0x" << std::hex << brti.format();
+            reportProblem(result, VALID_UNSUPPORTED, msg.str());
+            continue;
+        }
+        u32 pitch, surfSize;
+        surfaceLayout(DIV_ROUND_UP(brti.width(), blkWidth), DIV_ROUND_UP(brti.height(), blkHeight), bpp,
+                      brti.tileMode(), brti.alignment(), brti.sizeRange(), pitch, surfSize);
+        if (brti.imageSize() < surfSize) {
+            reportProblem(result, VALID_CORRUPT, where + ": imageSize " + std::to_string(brti.imageSize()) +
+                          " is smaller than its surface (" + std::to_string(surfSize) + ")");
+            continue;
+        }
+        result.textures++;
+    }
+}
+
+ValidateResult validateFile(const std::string& path) {
+    ValidateResult result;
+    MappedFile file;
+    bool bigEndian;
+    if (!file.open(path)) {
+        reportProblem(result, VALID_CORRUPT, "cannot be read");
+    } else if (file.size() < 0x100) {
+        reportProblem(result, VALID_CORRUPT, "file too small");
+    } else if (std::memcmp(file.data(), "BNTX", 4) != 0) {
+        reportProblem(result, VALID_CORRUPT, "not a BNTX file");
+    } else if (!readByteOrder(file.data(), bigEndian)) {
+        reportProblem(result, VALID_CORRUPT, "invalid byte order mark");
+    } else if (bigEndian) {
+        validateStructures<BigEndian>(file.data(), file.size(), result);
+    } else {
+        validateStructures<LittleEndian>(file.data(), file.size(), result);
+    }
+    return result;
+}
+
+// Checks every input on -j threads. Lines are printed in input order as soon
+// as all earlier files are done, so long runs show progress.
+int runValidate(int argc, char** argv) {
+    BatchOptions batch;
+    unsigned jobsCount = 0;
+    bool problemsOnly = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "-j" || arg == "--jobs") && i + 1 < argc) {
+            if (!parseOption(arg, argv[++i], jobsCount)) return 1;
+        } else if (arg == "--problems-only") {
+            problemsOnly = true;
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Error: unknown option " << arg << std::endl;
+            batch.inputs.clear();
+            break;
+        } else {
+            batch.inputs.push_back(arg);
+        }
+    }
+    if (batch.inputs.empty()) {
+        std::cerr << "Usage: validate [-j <n>] [--problems-only] <file.bntx | directory>..." << std::endl;
+        return 1;
+    }
+    if (jobsCount == 0) jobsCount = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<BatchJob> jobs = collectJobs(batch);
+    if (jobs.empty()) {
+        std::cerr << "Error: no .bntx files found" << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<ValidateResult> results(jobs.size());
+    std::vector<char> done(jobs.size(), 0);
+    size_t nextToPrint = 0;
+    std::mutex printLock;
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < std::min<size_t>(jobsCount, jobs.size()); w++) {
+        workers.emplace_back([&] {
+            for (size_t k; (k = next.fetch_add(1)) < jobs.size();) {
+                ValidateResult result = validateFile(jobs[k].inputPath);
+                std::lock_guard<std::mutex> guard(printLock);
+                results[k] = std::move(result);
+                done[k] = 1;
+                for (; nextToPrint < jobs.size() && done[nextToPrint]; nextToPrint++) {
+                    const ValidateResult& r = results[nextToPrint];
+                    if (problemsOnly && r.status == VALID_OK) continue;
+                    std::cout << std::left << std::setw(12) << VALIDATE_STATUS_NAMES[r.status] << std::right
+                              << jobs[nextToPrint].inputPath;
+                    if (r.status == VALID_OK) std::cout << " (" << r.textures << " textures)";
+                    else std::cout << ": " << r.detail;
+                    std::cout << "\n";
+                }
+            }
+        });
+    }
+    for (auto& t : workers) t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t counts[3] = {};
+    u64 textures = 0;
+    for (const auto& r : results) {
+        counts[r.status]++;
+        textures += r.textures;
+    }
+    std::cout << jobs.size() << " files: " << counts[VALID_OK] << " ok, " << counts[VALID_UNSUPPORTED]
+              << " unsupported, " << counts[VALID_CORRUPT] << " corrupt; " << textures << " textures in "
+              << std::fixed << std::setprecision(2) << seconds << "s (" << std::setprecision(0)
+              << jobs.size() / std::max(seconds, 1e-9) << " files/s)" << std::endl;
+    return counts[VALID_OK] == jobs.size() ? 0 : 1;
+}
+
+// ============================================================================
 // MAIN
 // ============================================================================
 
-int main() {
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        std::string command = argv[1];
+        if (command == "merge") return runMerge(argc - 1, argv + 1);
+        if (command == "bench") return runBench(argc - 1, argv + 1, argv[0]);
+        if (command == "sheet") return runSheet(argc - 1, argv + 1);
+        if (command == "validate") return runValidate(argc - 1, argv + 1);
+        return runBatch(argc, argv);
+    }
+
     std::cout << "BNTX to DDS Converter" << std::endl;
     std::cout << "==========================================\n" << std::endl;
 
@@ -465,7 +6241,7 @@ int main() {
     std::streamsize fileSize = file.tellg();
     file.seekg(0, std::ios::beg);
 
-    std::vector<u8> fileData(fileSize);
+    FileBuffer fileData(fileSize);
     if (!file.read(reinterpret_cast<char*>(fileData.data()), fileSize)) {
         std::cerr << "Error: File couldnt be read" << std::endl;
         return 1;
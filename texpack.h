@@ -0,0 +1,419 @@
+/*
+ * Texture pack format and reader
+ * Pre-untiled textures exported by the BNTX extractor (--pack), laid out so a
+ * reader can map the file and hand out texture pointers without parsing or
+ * copying anything.
+ *
+ * Layout (little endian, every struct naturally aligned):
+ *   TexPackHeader        at offset 0
+ *   texture payloads     each aligned to payloadAlignment (page size); further
+ *                        mips follow the first, MIP_ALIGNMENT aligned
+ *   name blob            NUL-terminated names
+ *   TexPackEntry[count]  at indexOffset, sorted by nameHash
+ *
+ * Payloads are linear (untiled) surfaces in the texture's own format; block
+ * compressed formats stay compressed, rows of blocks are tightly packed.
+ *
+ * Entries flagged FLAG_LZ4 store each mip as independent chunks of chunkSize
+ * uncompressed bytes, so chunks can be decoded in parallel or one at a time
+ * for random access. At mipOffset the mip holds:
+ *   uint32_t chunkEnd[n]   end of each chunk, relative to the end of this table
+ *   chunk data             LZ4 blocks; a chunk that would not shrink is stored
+ *                          raw, which is recognised by its size
+ * where n = ceil(mipSize / chunkSize) and mipSize is the uncompressed size.
+ */
+
+#ifndef TEXPACK_H
+#define TEXPACK_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace texpack {
+
+const char MAGIC[8] = {'T', 'E', 'X', 'P', 'A', 'C', 'K', 0};
+const uint32_t VERSION = 1;
+const uint32_t MAX_MIPS = 16;
+const uint32_t PAYLOAD_ALIGNMENT = 4096;
+const uint32_t MIP_ALIGNMENT = 16;
+
+const uint32_t FLAG_LZ4 = 1;
+
+struct TexPackHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t textureCount;
+    uint64_t indexOffset;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+    uint64_t fileSize;
+    uint32_t payloadAlignment;
+    uint32_t chunkSize;     // uncompressed bytes per chunk in FLAG_LZ4 entries
+    uint32_t reserved[2];
+};
+static_assert(sizeof(TexPackHeader) == 64, "TexPackHeader layout");
+
+struct TexPackEntry {
+    uint64_t nameHash;
+    uint32_t nameOffset;    // into the name blob
+    uint32_t nameLength;
+    uint32_t format;        // BNTX format word: type << 8 | channel type; 0 for
+                            // RGB8 normal maps (--normal-map rgb)
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipCount;
+    uint32_t blockWidth;
+    uint32_t blockHeight;
+    uint32_t bytesPerBlock;
+    uint32_t flags;
+    uint64_t mipOffset[MAX_MIPS];   // absolute file offsets
+    uint32_t mipSize[MAX_MIPS];
+    uint32_t reserved[4];
+};
+static_assert(sizeof(TexPackEntry) == 256, "TexPackEntry layout");
+
+// 64-bit FNV-1a, the hash the index is sorted by.
+inline uint64_t hashName(const char* name, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t)name[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// ============================================================================
+// LZ4 BLOCK CODEC
+// ============================================================================
+
+// Worst-case compressed size of n bytes.
+inline size_t lz4Bound(size_t n) { return n + n / 255 + 16; }
+
+// Greedy single-pass LZ4 block compressor. dst needs lz4Bound(n) bytes.
+inline size_t lz4Compress(const uint8_t* src, size_t n, uint8_t* dst) {
+    const size_t MIN_MATCH = 4, LAST_LITERALS = 5, MF_LIMIT = 12;
+    uint32_t table[1 << 12] = {};
+    uint8_t* op = dst;
+    size_t anchor = 0;
+
+    auto read32 = [&](size_t p) { uint32_t v; std::memcpy(&v, src + p, 4); return v; };
+    auto writeLength = [&](size_t len) {
+        for (; len >= 255; len -= 255) *op++ = 255;
+        *op++ = (uint8_t)len;
+    };
+    auto emit = [&](size_t litEnd, size_t offset, size_t matchLen) {
+        size_t lit = litEnd - anchor;
+        uint8_t* token = op++;
+        *token = (uint8_t)((lit >= 15 ? 15 : lit) << 4);
+        if (lit >= 15) writeLength(lit - 15);
+        std::memcpy(op, src + anchor, lit);
+        op += lit;
+        if (matchLen == 0) return;
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        size_t ml = matchLen - MIN_MATCH;
+        *token |= (uint8_t)(ml >= 15 ? 15 : ml);
+        if (ml >= 15) writeLength(ml - 15);
+    };
+
+    if (n > MF_LIMIT) {
+        size_t limit = n - MF_LIMIT, matchLimit = n - LAST_LITERALS;
+        size_t i = 0, misses = 0;
+        while (i < limit) {
+            uint32_t seq = read32(i);
+            uint32_t h = (seq * 2654435761u) >> 20;
+            size_t ref = table[h];
+            table[h] = (uint32_t)i;
+            if (ref < i && i - ref <= 65535 && read32(ref) == seq) {
+                size_t len = MIN_MATCH;
+                while (i + len < matchLimit && src[ref + len] == src[i + len]) len++;
+                emit(i, i - ref, len);
+                i += len;
+                anchor = i;
+                misses = 0;
+            } else {
+                i += 1 + (misses++ >> 6);
+            }
+        }
+    }
+    emit(n, 0, 0);
+    return op - dst;
+}
+
+// Bounds-checked LZ4 block decoder; fails unless exactly dstSize bytes result.
+inline bool lz4Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize) {
+    const uint8_t* ip = src;
+    const uint8_t* ipEnd = src + srcSize;
+    uint8_t* op = dst;
+    uint8_t* opEnd = dst + dstSize;
+
+    auto readLength = [&](size_t& len) {
+        uint8_t b;
+        do {
+            if (ip >= ipEnd) return false;
+            b = *ip++;
+            len += b;
+        } while (b == 255);
+        return true;
+    };
+
+    while (ip < ipEnd) {
+        uint8_t token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15 && !readLength(lit)) return false;
+        if (lit > (size_t)(ipEnd - ip) || lit > (size_t)(opEnd - op)) return false;
+        std::memcpy(op, ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == ipEnd) break;
+
+        if (ipEnd - ip < 2) return false;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t len = token & 15;
+        if (len == 15 && !readLength(len)) return false;
+        len += 4;
+        if (offset == 0 || offset > (size_t)(op - dst) || len > (size_t)(opEnd - op)) return false;
+        const uint8_t* match = op - offset;
+        if (offset >= len) {
+            std::memcpy(op, match, len);
+            op += len;
+        } else {
+            for (size_t k = 0; k < len; k++) *op++ = match[k];
+        }
+    }
+    return op == opEnd;
+}
+
+// Maps a pack read-only. Entries, names and payload pointers point straight
+// into the mapping and stay valid until the reader is closed or destroyed.
+class TexPackReader {
+public:
+    TexPackReader() = default;
+    TexPackReader(const TexPackReader&) = delete;
+    TexPackReader& operator=(const TexPackReader&) = delete;
+    ~TexPackReader() { close(); }
+
+    bool open(const char* path) {
+        close();
+        if (!map(path)) return false;
+        if (!validate()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (base) UnmapViewOfFile(base);
+        if (mapping) CloseHandle(mapping);
+        mapping = nullptr;
+#else
+        if (base) munmap((void*)base, size);
+#endif
+        base = nullptr;
+        size = 0;
+    }
+
+    bool isOpen() const { return base != nullptr; }
+
+    // Zero while no pack is open.
+    uint32_t count() const { return isOpen() ? header()->textureCount : 0; }
+
+    const TexPackEntry& entry(uint32_t i) const { return entries()[i]; }
+
+    const char* name(const TexPackEntry& e) const {
+        return reinterpret_cast<const char*>(base + header()->namesOffset + e.nameOffset);
+    }
+
+    // Binary search on the name hash, then a name compare for collisions.
+    const TexPackEntry* find(const char* texName) const {
+        if (!isOpen()) return nullptr;
+        size_t len = std::strlen(texName);
+        uint64_t h = hashName(texName, len);
+        const TexPackEntry* e = entries();
+        uint32_t lo = 0, hi = count();
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (e[mid].nameHash < h) lo = mid + 1;
+            else hi = mid;
+        }
+        for (; lo < count() && e[lo].nameHash == h; lo++) {
+            if (e[lo].nameLength == len && std::memcmp(name(e[lo]), texName, len) == 0) return &e[lo];
+        }
+        return nullptr;
+    }
+
+    // Direct pointer to an uncompressed mip; FLAG_LZ4 entries go through read().
+    const uint8_t* data(const TexPackEntry& e, uint32_t mip = 0) const {
+        return mip < e.mipCount && !compressed(e) ? base + e.mipOffset[mip] : nullptr;
+    }
+
+    // Uncompressed size of a mip.
+    uint32_t dataSize(const TexPackEntry& e, uint32_t mip = 0) const {
+        return mip < e.mipCount ? e.mipSize[mip] : 0;
+    }
+
+    bool compressed(const TexPackEntry& e) const { return (e.flags & FLAG_LZ4) != 0; }
+
+    // Chunks of a FLAG_LZ4 mip; each decodes independently with readChunk().
+    uint32_t chunkCount(const TexPackEntry& e, uint32_t mip = 0) const {
+        uint32_t chunk = header()->chunkSize;
+        return chunk ? (uint32_t)(((uint64_t)dataSize(e, mip) + chunk - 1) / chunk) : 0;
+    }
+
+    // Decodes one chunk of a FLAG_LZ4 mip into dst, which receives up to
+    // chunkSize bytes (less for the last chunk).
+    bool readChunk(const TexPackEntry& e, uint32_t mip, uint32_t chunk, uint8_t* dst) const {
+        if (!compressed(e) || mip >= e.mipCount || chunk >= chunkCount(e, mip)) return false;
+        const uint32_t* ends = reinterpret_cast<const uint32_t*>(base + e.mipOffset[mip]);
+        const uint8_t* stored = reinterpret_cast<const uint8_t*>(ends + chunkCount(e, mip));
+        uint32_t begin = chunk ? ends[chunk - 1] : 0;
+        uint32_t storedSize = ends[chunk] - begin;
+        uint32_t rawSize = chunkRawSize(e, mip, chunk);
+        if (storedSize == rawSize) {
+            std::memcpy(dst, stored + begin, rawSize);
+            return true;
+        }
+        return lz4Decompress(stored + begin, storedSize, dst, rawSize);
+    }
+
+    // Copies [offset, offset + count) of a mip's uncompressed data into dst,
+    // decoding only the chunks that overlap the range.
+    bool read(const TexPackEntry& e, uint32_t mip, uint64_t offset, uint64_t count, uint8_t* dst) const {
+        if (mip >= e.mipCount || offset > e.mipSize[mip] || count > e.mipSize[mip] - offset) return false;
+        if (!compressed(e)) {
+            std::memcpy(dst, base + e.mipOffset[mip] + offset, count);
+            return true;
+        }
+        uint32_t chunkSize = header()->chunkSize;
+        std::unique_ptr<uint8_t[]> scratch(new uint8_t[chunkSize]);
+        bool ok = true;
+        while (ok && count > 0) {
+            uint32_t chunk = (uint32_t)(offset / chunkSize);
+            uint64_t within = offset % chunkSize;
+            uint64_t take = chunkRawSize(e, mip, chunk) - within;
+            if (take > count) take = count;
+            ok = readChunk(e, mip, chunk, scratch.get());
+            if (ok) std::memcpy(dst, scratch.get() + within, take);
+            dst += take;
+            offset += take;
+            count -= take;
+        }
+        return ok;
+    }
+
+private:
+    const uint8_t* base = nullptr;
+    uint64_t size = 0;
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#endif
+
+    const TexPackHeader* header() const { return reinterpret_cast<const TexPackHeader*>(base); }
+    const TexPackEntry* entries() const {
+        return reinterpret_cast<const TexPackEntry*>(base + header()->indexOffset);
+    }
+
+    uint32_t chunkRawSize(const TexPackEntry& e, uint32_t mip, uint32_t chunk) const {
+        uint64_t begin = (uint64_t)chunk * header()->chunkSize;
+        uint64_t left = e.mipSize[mip] - begin;
+        return (uint32_t)(left < header()->chunkSize ? left : header()->chunkSize);
+    }
+
+    // A compressed mip's chunk table must fit, grow monotonically, keep every
+    // chunk within its raw size and end inside the file.
+    bool validateChunks(const TexPackEntry& e, uint32_t mip) const {
+        uint64_t n = chunkCount(e, mip);
+        uint64_t tableEnd = e.mipOffset[mip] + n * sizeof(uint32_t);
+        if (e.mipOffset[mip] % alignof(uint32_t) != 0 || e.mipOffset[mip] > size || tableEnd > size) return false;
+        const uint32_t* ends = reinterpret_cast<const uint32_t*>(base + e.mipOffset[mip]);
+        uint32_t prev = 0;
+        for (uint32_t c = 0; c < n; c++) {
+            if (ends[c] < prev || ends[c] - prev > chunkRawSize(e, mip, c)) return false;
+            prev = ends[c];
+        }
+        return prev <= size - tableEnd;
+    }
+
+    bool map(const char* path) {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!mapping) return false;
+        base = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        size = (uint64_t)fileSize.QuadPart;
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        base = static_cast<const uint8_t*>(p);
+        size = (uint64_t)st.st_size;
+#endif
+        return base != nullptr;
+    }
+
+    // Checks the header, that every index entry points inside the file and
+    // that each name ends in its NUL, once at open, so lookups need no further
+    // checks.
+    bool validate() const {
+        if (size < sizeof(TexPackHeader)) return false;
+        const TexPackHeader* h = header();
+        if (std::memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0 || h->version != VERSION) return false;
+        if (h->fileSize != size) return false;
+        if (h->indexOffset % alignof(TexPackEntry) != 0) return false;
+        if (h->indexOffset > size || (size - h->indexOffset) / sizeof(TexPackEntry) < h->textureCount) return false;
+        if (h->namesOffset > size || h->namesSize > size - h->namesOffset) return false;
+
+        const TexPackEntry* e = entries();
+        for (uint32_t i = 0; i < h->textureCount; i++) {
+            uint64_t nameEnd = (uint64_t)e[i].nameOffset + e[i].nameLength;
+            if (nameEnd >= h->namesSize || base[h->namesOffset + nameEnd] != 0) return false;
+            if (e[i].mipCount > MAX_MIPS) return false;
+            for (uint32_t m = 0; m < e[i].mipCount; m++) {
+                if (e[i].flags & FLAG_LZ4) {
+                    if (h->chunkSize == 0 || !validateChunks(e[i], m)) return false;
+                } else if (e[i].mipOffset[m] > size || e[i].mipSize[m] > size - e[i].mipOffset[m]) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace texpack
+
+#endif